@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ROOT {
+  class VarrLeaf;
+
+  struct RawArrayView {
+    const void* data = nullptr;
+    std::size_t size = 0;
+  };
+
+  /* A read-only view over the content of a variable-sized array branch for the current entry
+   * @T the element type
+   *
+   * The view points either to the read buffer of the VarrLeaf, or directly into the decoded block of the VarrGroup
+   * when bulk reading is enabled. It is updated each time <TreeWrapper::next> is called.
+   */
+  template<typename T>
+  class ArrayView : private RawArrayView {
+    public:
+      const T* data() const { return static_cast<const T*>(RawArrayView::data); }
+      std::size_t size() const { return RawArrayView::size; }
+      bool empty() const { return RawArrayView::size == 0; }
+
+      const T& operator[](std::size_t i) const { return data()[i]; }
+
+      const T* begin() const { return data(); }
+      const T* end() const { return data() + size(); }
+
+    private:
+      friend class VarrLeaf;
+  };
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TBranch;
+class TLeaf;
+class TObjArray;
+class TTree;
+
+namespace ROOT {
+
+    /* Name to branch index of a tree
+     *
+     * `TTree::GetBranch` and `TTree::GetLeaf` search the branches one by one, which is slow on trees with thousands of
+     * branches. The index is built in a single pass over all the branches, stored in depth-first order, so that a branch
+     * and all its sub-branches form a contiguous range which can be activated at once.
+     *
+     * When the index is rebuilt for another tree with the same schema (for example the next file of a TChain), the
+     * name lookup table is kept and only the branch pointers are refreshed.
+     */
+    class BranchIndex {
+        public:
+            struct Stats {
+                // Number of full builds, and of rebuilds which reused the schema of the previous tree
+                uint64_t builds = 0;
+                uint64_t reuses = 0;
+                // Number of branches in the last indexed tree, including sub-branches
+                std::size_t branches = 0;
+                // Total time spent building the index, in seconds
+                double seconds = 0;
+
+                void print(std::ostream& out = std::cout) const;
+            };
+
+            /* Index the branches of a tree
+             * @tree the tree. For a TChain, pass the current tree of the chain.
+             */
+            void build(TTree* tree);
+
+            /* Mark the index as outdated. It will be rebuilt by the next call to <build>. */
+            void invalidate() {
+                m_tree = nullptr;
+            }
+
+            /* Check if the index is up-to-date for <tree> */
+            bool isFor(const TTree* tree) const {
+                return m_tree && m_tree == tree;
+            }
+
+            /* Find a branch
+             * @name the branch name
+             *
+             * Fall back to `TTree::GetBranch` if the name is not in the index, for branches of friend trees for example.
+             *
+             * @return the branch, or null if it does not exist
+             */
+            TBranch* branch(const std::string& name) const;
+
+            /* Find a leaf
+             * @name the leaf name
+             *
+             * @return the leaf, or null if it does not exist
+             */
+            TLeaf* leaf(const std::string& name) const;
+
+            /* Set the status of a branch and of all its sub-branches to 1
+             * @name the branch name
+             *
+             * @return false if the branch is not in the index
+             */
+            bool activate(const std::string& name) const;
+
+            const Stats& stats() const { return m_stats; }
+
+        private:
+            void collect(TObjArray* branches, std::vector<TBranch*>& flat, std::vector<std::size_t>& ends);
+
+            TTree* m_tree = nullptr;
+
+            // Branches in depth-first order. The sub-branches of branch i are [i + 1, m_ends[i]).
+            std::vector<TBranch*> m_branches;
+            std::vector<std::size_t> m_ends;
+
+            std::vector<std::string> m_names;
+            std::unordered_map<std::string, std::size_t> m_positions;
+
+            Stats m_stats;
+    };
+};
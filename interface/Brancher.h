@@ -1,12 +1,26 @@
 #pragma once
 
+#include <iostream>
 #include <string>
 
 #include <TTree.h>
 #include <TLeaf.h>
 
+#include "TreeWrapperAccessor.h"
+
 namespace ROOT {
 
+    /* Options used when creating a branch in write mode
+     *
+     * See `TTree::Branch` for the meaning of the basket size and split level.
+     */
+    struct BranchOptions {
+        int basketSize = 32000;
+        int splitLevel = 99;
+        // Compression settings, as returned by `ROOT::CompressionSettings`. -1 to use the settings of the file.
+        int compression = -1;
+    };
+
     namespace utils {
 
         /* Set the branch status to 1 and activate the branch <branch>.
@@ -16,29 +30,83 @@ namespace ROOT {
          * If this branch has any sub-branches, they will also be activated (useful if <branch> points to a complex object and the branch has a split-mode greater than 0).
          */
         void activateBranch(TBranch* branch);
+
+        /* Apply the options that can be changed after the creation of a branch
+         * @branch the branch. Can be null.
+         * @options the options to apply
+         */
+        void applyBranchOptions(TBranch* branch, const BranchOptions& options);
+
+        /* Type code of <T> in a `TTree::Branch` leaf list, for example 'F' for float.
+         *
+         * Only defined for basic types.
+         */
+        template<typename T> struct leaflist_type;
+
+        template<> struct leaflist_type<char> { static constexpr const char* value = "B"; };
+        template<> struct leaflist_type<unsigned char> { static constexpr const char* value = "b"; };
+        template<> struct leaflist_type<short> { static constexpr const char* value = "S"; };
+        template<> struct leaflist_type<unsigned short> { static constexpr const char* value = "s"; };
+        template<> struct leaflist_type<int> { static constexpr const char* value = "I"; };
+        template<> struct leaflist_type<unsigned int> { static constexpr const char* value = "i"; };
+        template<> struct leaflist_type<float> { static constexpr const char* value = "F"; };
+        template<> struct leaflist_type<double> { static constexpr const char* value = "D"; };
+        template<> struct leaflist_type<long long> { static constexpr const char* value = "L"; };
+        template<> struct leaflist_type<unsigned long long> { static constexpr const char* value = "l"; };
+        template<> struct leaflist_type<long> { static constexpr const char* value = "G"; };
+        template<> struct leaflist_type<unsigned long> { static constexpr const char* value = "g"; };
+        template<> struct leaflist_type<bool> { static constexpr const char* value = "O"; };
     }
 }
 
 struct Brancher {
     public:
         virtual void operator()(const std::string&, TTree* tree) = 0;
+
+        // Same, but branches are looked up through the index of the wrapper
+        virtual void operator()(const std::string& name, ROOT::TreeWrapperAccessor& tree) {
+            (*this)(name, tree.tree());
+        }
+
         virtual ~Brancher() {}
 };
 
 template <typename T>
 struct BranchCreaterT: Brancher {
     public:
-        BranchCreaterT(T& data, TBranch** branch)
-            : m_data(data), m_branch(branch) {
+        BranchCreaterT(T& data, TBranch** branch, const ROOT::BranchOptions& options)
+            : m_data(data), m_branch(branch), m_options(options) {
             }
 
         virtual void operator()(const std::string& name, TTree* tree) {
-            *m_branch = tree->Branch<T>(name.c_str(), &m_data);
+            *m_branch = tree->Branch<T>(name.c_str(), &m_data, m_options.basketSize, m_options.splitLevel);
+            ROOT::utils::applyBranchOptions(*m_branch, m_options);
         }
 
     private:
         T& m_data;
         TBranch** m_branch;
+        ROOT::BranchOptions m_options;
+};
+
+template <typename T>
+struct VarrBranchCreaterT: Brancher {
+    public:
+        VarrBranchCreaterT(void* data, TBranch** branch, const std::string& lenName, const ROOT::BranchOptions& options)
+            : m_data(data), m_branch(branch), m_lenName(lenName), m_options(options) {
+            }
+
+        virtual void operator()(const std::string& name, TTree* tree) {
+            const std::string leaflist = name + "[" + m_lenName + "]/" + ROOT::utils::leaflist_type<T>::value;
+            *m_branch = tree->Branch(name.c_str(), m_data, leaflist.c_str(), m_options.basketSize);
+            ROOT::utils::applyBranchOptions(*m_branch, m_options);
+        }
+
+    private:
+        void* m_data;
+        TBranch** m_branch;
+        std::string m_lenName;
+        ROOT::BranchOptions m_options;
 };
 
 template <typename T>
@@ -53,10 +121,21 @@ struct BranchReaderT: Brancher {
             }
 
         virtual void operator()(const std::string& name, TTree* tree) {
-            *m_branch = tree->GetBranch(name.c_str());
+            if (attach(name, tree, tree->GetBranch(name.c_str())))
+                ROOT::utils::activateBranch((*m_branch));
+        }
+
+        virtual void operator()(const std::string& name, ROOT::TreeWrapperAccessor& tree) {
+            if (attach(name, tree.tree(), tree.branch(name)))
+                tree.activate(name, *m_branch);
+        }
+
+    private:
+        bool attach(const std::string& name, TTree* tree, TBranch* branch) {
+            *m_branch = branch;
             if (! *m_branch) {
                 std::cout << "Warning: branch '" << name << "' not found in tree" << std::endl;
-                return;
+                return false;
             }
 
             if (m_data)
@@ -64,10 +143,9 @@ struct BranchReaderT: Brancher {
             else
                 tree->SetBranchAddress<T>(name.c_str(), m_data_ptr, m_branch);
 
-            ROOT::utils::activateBranch((*m_branch));
+            return true;
         }
 
-    private:
         T* m_data = nullptr;
         T** m_data_ptr = nullptr;
         TBranch** m_branch;
@@ -81,10 +159,21 @@ struct VarrBranchReaderT : Brancher {
             }
 
         virtual void operator()(const std::string& name, TTree* tree) {
-            *m_branch = tree->GetBranch(name.c_str());
+            if (attach(name, tree, tree->GetBranch(name.c_str())))
+                ROOT::utils::activateBranch(*m_branch);
+        }
+
+        virtual void operator()(const std::string& name, ROOT::TreeWrapperAccessor& tree) {
+            if (attach(name, tree.tree(), tree.branch(name)))
+                tree.activate(name, *m_branch);
+        }
+
+    private:
+        bool attach(const std::string& name, TTree* tree, TBranch* branch) {
+            *m_branch = branch;
             if (! *m_branch) {
                 std::cout << "Warning: branch '" << name << "' not found in tree" << std::endl;
-                return;
+                return false;
             }
             TLeaf* leaf = (*m_branch)->GetLeaf(name.c_str());
             TLeaf* leafCount = leaf->GetLeafCount();
@@ -96,9 +185,9 @@ struct VarrBranchReaderT : Brancher {
 
             tree->SetBranchAddress<T>(name.c_str(), m_data, m_branch);
 
-            ROOT::utils::activateBranch(*m_branch);
+            return true;
         }
-    private:
+
         T* m_data;
         TBranch** m_branch;
         std::string m_lenName;
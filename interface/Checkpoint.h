@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace ROOT {
+
+    /* Iteration state of a <TreeWrapper>, saved by <TreeWrapper::setCheckpoint>
+     *
+     * The state is stored as a small text file, one `key value` pair per line, followed by the opaque data saved by the
+     * user callback.
+     */
+    struct Checkpoint {
+        // Next entry to read. All the entries before it have been processed.
+        uint64_t entry = 0;
+        uint64_t stopAt = 0;
+        bool stopAtSet = false;
+
+        // Number of entries of the tree or chain, used to check that it did not change. 0 if unknown.
+        uint64_t entries = 0;
+
+        // Current tree of a TChain, used to check that the chain did not change. -1 for a TTree.
+        int treeNumber = -1;
+        // File of the current tree of a TChain, or of the TTree. Empty for a tree in memory.
+        std::string fileName;
+
+        // Data saved by the user callback
+        std::string user;
+
+        /* Write the state to a file
+         * @path the file path
+         *
+         * The state is written to a temporary file, flushed to disk and renamed, so that <path> always holds a complete
+         * state even if the job is killed while writing. Throw `std::runtime_error` in case of error.
+         */
+        void write(const std::string& path) const;
+
+        /* Read the state from a file
+         * @path the file path
+         *
+         * Throw `std::runtime_error` if the file is not a valid checkpoint.
+         *
+         * @return false if the file does not exist
+         */
+        bool read(const std::string& path);
+    };
+};
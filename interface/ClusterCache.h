@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ROOT {
+
+    /* Decoded content of one branch over one cluster
+     *
+     * Entries are stored contiguously, <elementSize> bytes per entry. Entries are local to the tree the cluster belongs to.
+     */
+    struct ClusterBlock {
+        int64_t first;
+        int64_t last;
+        size_t elementSize;
+        std::vector<char> data;
+
+        const char* at(int64_t entry) const {
+            return data.data() + (entry - first) * elementSize;
+        }
+    };
+
+    /* Process-wide cache of decoded clusters
+     *
+     * Several <TreeWrapper> reading the same file in the same process share the blocks stored here instead of each
+     * decompressing the same baskets. Blocks are keyed by file UUID, full path and cycle of the tree, branch and first
+     * entry of the cluster, and are evicted in least-recently-used order once the cache grows above its maximum size.
+     *
+     * Each block is charged to the owner which inserted it, see <newOwner>. An owner can be given its own maximum size,
+     * so that a reader keeping its memory under a budget only evicts its own blocks.
+     *
+     * All methods are thread-safe. Blocks are handed out as `shared_ptr`, so an evicted block stays valid for as long as
+     * a reader holds it.
+     */
+    class ClusterCache {
+        public:
+            /* Access the process-wide instance
+             */
+            static ClusterCache& instance();
+
+            /* Build the key identifying a cluster
+             * @file the identity of the file, its UUID
+             * @tree the tree, with the path of its directory and its cycle
+             * @branch the branch name
+             * @first the first entry of the cluster
+             */
+            static std::string key(const std::string& file, const std::string& tree, const std::string& branch, int64_t first);
+
+            /* Look up a block
+             * @key the key, built with <key>
+             *
+             * @return the block, or null if not in the cache
+             */
+            std::shared_ptr<const ClusterBlock> get(const std::string& key);
+
+            /* Insert a block
+             * @key the key, built with <key>
+             * @block the block to insert
+             * @owner the owner the block is charged to, see <newOwner>. 0 for none.
+             *
+             * If another block was inserted in the meantime with the same key, the existing block is kept and returned.
+             *
+             * @return the block stored in the cache
+             */
+            std::shared_ptr<const ClusterBlock> put(const std::string& key, std::shared_ptr<const ClusterBlock> block, uint64_t owner = 0);
+
+            /* Create a new owner, never 0 */
+            uint64_t newOwner();
+
+            /* Forget an owner. Its blocks stay in the cache, but are not charged to anyone anymore. */
+            void releaseOwner(uint64_t owner);
+
+            /* Set the maximum size of the blocks charged to an owner
+             * @owner the owner, see <newOwner>
+             * @bytes the maximum number of bytes. 0 for no limit other than the size of the cache.
+             *
+             * The least recently used blocks of the owner are evicted first, other blocks are not affected.
+             */
+            void setOwnerMaxSize(uint64_t owner, size_t bytes);
+
+            /* Size of the blocks charged to an owner, in bytes */
+            size_t ownerSize(uint64_t owner) const;
+
+            /* Set the maximum size of the cache
+             * @bytes the maximum number of bytes of decoded data to keep
+             */
+            void setMaxSize(size_t bytes);
+
+            size_t getMaxSize() const { return m_max_size; }
+
+            /* Current size of the cache, in bytes */
+            size_t size() const;
+
+            /* Remove all the blocks from the cache */
+            void clear();
+
+            uint64_t hits() const { return m_hits; }
+            uint64_t misses() const { return m_misses; }
+
+        private:
+            ClusterCache();
+            ClusterCache(const ClusterCache&) = delete;
+            ClusterCache& operator=(const ClusterCache&) = delete;
+
+            struct Item {
+                std::string key;
+                std::shared_ptr<const ClusterBlock> block;
+                uint64_t owner;
+            };
+
+            struct Owner {
+                size_t size = 0;
+                size_t max_size = 0;
+            };
+
+            void evict();
+            // Evict the least recently used blocks of <owner> until it is under its maximum size
+            void evictOwner(uint64_t owner);
+            void remove(std::list<Item>::iterator item);
+
+            mutable std::mutex m_mutex;
+            std::list<Item> m_items;
+            std::unordered_map<std::string, std::list<Item>::iterator> m_index;
+            std::unordered_map<uint64_t, Owner> m_owners;
+
+            size_t m_size = 0;
+            size_t m_max_size;
+
+            std::atomic<uint64_t> m_hits;
+            std::atomic<uint64_t> m_misses;
+            std::atomic<uint64_t> m_next_owner;
+    };
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+class TTree;
+
+namespace ROOT {
+
+    /* Smallest and largest values of a numeric branch over a range of entries */
+    struct ValueRange {
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        // Number of entries holding NaN, not included in <min> and <max>
+        uint64_t nulls = 0;
+
+        void add(double value) {
+            add(value, value);
+        }
+
+        /* Add a value known to lie in [<low>, <high>], for values not exactly representable as a double */
+        void add(double low, double high) {
+            if (low != low) {
+                nulls++;
+                return;
+            }
+            min = std::min(min, low);
+            max = std::max(max, high);
+        }
+
+        void merge(const ValueRange& o) {
+            min = std::min(min, o.min);
+            max = std::max(max, o.max);
+            nulls += o.nulls;
+        }
+    };
+
+    /* A condition on a numeric branch, like `nJet >= 4` */
+    struct ClusterPredicate {
+        enum class Op {
+            Less,
+            LessEqual,
+            Greater,
+            GreaterEqual,
+            Equal,
+            NotEqual
+        };
+
+        std::string branch;
+        Op op = Op::Greater;
+        double value = 0;
+
+        /* Parse a predicate
+         * @expression a branch name, one of `<`, `<=`, `>`, `>=`, `==`, `!=`, and a number. For example `met > 200`.
+         *
+         * Throw `std::runtime_error` if the expression is not valid.
+         */
+        static ClusterPredicate parse(const std::string& expression);
+
+        /* Check if no entry of a range can satisfy the predicate
+         * @range the values of <branch> over the range
+         *
+         * NaN values satisfy `!=` only, like in C++.
+         */
+        bool excludes(const ValueRange& range) const;
+    };
+
+    /* Per-cluster minimum, maximum and NaN count of some numeric branches of a tree
+     *
+     * Statistics are stored in the user info of the tree (`TTree::GetUserInfo`) under the name <kName>, and are thus
+     * written together with the tree. Entry numbers are local to the tree.
+     */
+    class ClusterStats {
+        public:
+            static const char* const kName;
+
+            /* Load the statistics stored in a tree
+             * @tree the tree
+             *
+             * @return false if the tree holds no valid statistics, in which case this object is left empty
+             */
+            bool load(TTree* tree);
+
+            /* Store the statistics in the user info of a tree, replacing the previous ones */
+            void save(TTree* tree) const;
+
+            void clear();
+
+            // Number of clusters covered
+            std::size_t clusters() const {
+                return m_starts.empty() ? 0 : m_starts.size() - 1;
+            }
+
+            /* Find the cluster holding an entry
+             * @entry the entry, local to the tree
+             *
+             * @return the index of the cluster, or <clusters> if the entry is not covered
+             */
+            std::size_t find(uint64_t entry) const;
+
+            // Range of entries of a cluster: [first, end)
+            uint64_t first(std::size_t cluster) const { return m_starts[cluster]; }
+            uint64_t end(std::size_t cluster) const { return m_starts[cluster + 1]; }
+
+            /* Position of a branch in the statistics
+             * @name the branch name
+             *
+             * @return the position, or -1 if there are no statistics for this branch
+             */
+            int column(const std::string& name) const;
+
+            const ValueRange& range(std::size_t column, std::size_t cluster) const {
+                return m_ranges[column][cluster];
+            }
+
+            const std::vector<std::string>& names() const { return m_names; }
+
+        private:
+            friend class ClusterStatsRecorder;
+
+            std::vector<std::string> m_names;
+            // First entry of each cluster, followed by the end of the last cluster
+            std::vector<uint64_t> m_starts;
+            // One range per cluster, for each branch
+            std::vector<std::vector<ValueRange>> m_ranges;
+    };
+
+    /* Accumulate <ClusterStats> while a tree is filled
+     *
+     * The cluster layout of a tree is only final once its baskets are flushed, so values are first accumulated by blocks
+     * of a fixed number of entries. Blocks are merged into clusters by <build>, a block overlapping two clusters counting
+     * for both. Statistics are exact when the number of entries per cluster is a multiple of the block size, and always
+     * conservative otherwise.
+     */
+    class ClusterStatsRecorder {
+        public:
+            /* Create a recorder
+             * @names the names of the branches
+             * @granularity the number of entries per block
+             */
+            ClusterStatsRecorder(const std::vector<std::string>& names, std::size_t granularity = 1000);
+
+            /* Add the value of a branch for the current entry
+             * @column the position of the branch in <names>
+             * @low the value, rounded down
+             * @high the value, rounded up
+             */
+            void add(std::size_t column, double low, double high) {
+                m_blocks[m_block + column].add(low, high);
+            }
+
+            // Move to the next entry
+            void endEntry();
+
+            /* Merge the blocks into the clusters of a tree
+             * @tree the tree filled with the recorded entries
+             * @stats filled with the statistics
+             *
+             * @return false if the tree does not hold as many entries as recorded
+             */
+            bool build(TTree* tree, ClusterStats& stats) const;
+
+            const std::vector<std::string>& names() const { return m_names; }
+            std::size_t granularity() const { return m_granularity; }
+
+        private:
+            std::vector<std::string> m_names;
+            std::size_t m_granularity;
+
+            uint64_t m_entries = 0;
+
+            // One range per branch for each block, block after block
+            std::vector<ValueRange> m_blocks;
+            // Position of the current block in <m_blocks>
+            std::size_t m_block = 0;
+    };
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "ArrayView.h"
+#include "IndexSequence.h"
+
+namespace ROOT {
+
+    /* Binding between a member of a struct and a variable-sized array branch
+     * @T the struct type
+     * @F the type of the member, and of the elements of the branch
+     *
+     * Use <field> to create a binding.
+     */
+    template<typename T, typename F>
+    struct CollectionField {
+        std::string name;
+        F T::* member;
+    };
+
+    /* Bind the member <member> of <T> to the branch <name>
+     * @name the branch name
+     * @member pointer to the member, for example `&Jet::pt`
+     */
+    template<typename T, typename F>
+    CollectionField<T, F> field(const std::string& name, F T::* member) {
+        return CollectionField<T, F>{name, member};
+    }
+
+    /* An array-of-structs view over the branches of a VarrGroup
+     * @T the struct type. Must be default constructible.
+     * @F the types of the bound members
+     *
+     * The elements of the collection are lightweight proxies: `element.get<I>()` reads the member bound by the field <I>,
+     * in the order given at creation, directly from the buffer of its branch. The field is resolved at compile time, and
+     * an index without a field does not compile. Nothing is copied or allocated when a new entry is read, or when an
+     * element is accessed. An element is converted to a full <T> only when asked for, which loads every bound member.
+     * The collection stays valid for the whole event loop, so create it once, before the loop:
+     *
+     * ```
+     * struct Jet { float pt, eta; };
+     *
+     * auto jets = tree.collection<Jet>("nJet", ROOT::field("Jet_pt", &Jet::pt), ROOT::field("Jet_eta", &Jet::eta));
+     * while (tree.next()) {
+     *     for (auto jet: jets) {
+     *         float pt = jet.get<0>();
+     *         Jet copy = jet;
+     *         [...]
+     *     }
+     * }
+     * ```
+     *
+     * The only way to create a Collection is from <VarrGroup::collection> or <TreeWrapper::collection>.
+     */
+    template<typename T, typename... F>
+    class Collection {
+        public:
+            /* Element of the current entry, reading the bound branches on access */
+            class Element {
+                public:
+                    /* Value of the member bound by the field <I>, read from the buffer of its branch */
+                    template<std::size_t I>
+                    const typename std::tuple_element<I, std::tuple<F...>>::type& get() const {
+                        return (*std::get<I>(m_collection->m_views))[m_index];
+                    }
+
+                    /* Build a copy of the element, loading every bound member */
+                    T value() const {
+                        T result;
+                        m_collection->fill(result, m_index, utils::make_index_sequence<sizeof...(F)>());
+
+                        return result;
+                    }
+
+                    operator T() const {
+                        return value();
+                    }
+
+                    std::size_t index() const { return m_index; }
+
+                private:
+                    friend class Collection;
+
+                    Element(const Collection* collection, std::size_t index):
+                        m_collection(collection),
+                        m_index(index) {
+
+                        }
+
+                    const Collection* m_collection;
+                    std::size_t m_index;
+            };
+
+            class iterator {
+                public:
+                    Element operator*() const { return Element(m_collection, m_index); }
+
+                    iterator& operator++() {
+                        ++m_index;
+                        return *this;
+                    }
+
+                    bool operator==(const iterator& o) const { return m_index == o.m_index; }
+                    bool operator!=(const iterator& o) const { return m_index != o.m_index; }
+
+                private:
+                    friend class Collection;
+
+                    iterator(const Collection* collection, std::size_t index):
+                        m_collection(collection),
+                        m_index(index) {
+
+                        }
+
+                    const Collection* m_collection;
+                    std::size_t m_index;
+            };
+
+            /* Number of elements in the current entry */
+            std::size_t size() const {
+                return std::get<0>(m_views)->size();
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            /* Element <i> of the current entry */
+            Element operator[](std::size_t i) const {
+                return Element(this, i);
+            }
+
+            iterator begin() const { return iterator(this, 0); }
+            iterator end() const { return iterator(this, size()); }
+
+        private:
+            friend class VarrGroup;
+
+            Collection(std::tuple<F T::*...> members, std::tuple<const ArrayView<F>*...> views):
+                m_members(members),
+                m_views(views) {
+
+                }
+
+            template<std::size_t... I>
+            void fill(T& result, std::size_t i, utils::index_sequence<I...>) const {
+                int expand[] = {0, ((result.*std::get<I>(m_members) = (*std::get<I>(m_views))[i]), 0)...};
+                (void) expand;
+            }
+
+            std::tuple<F T::*...> m_members;
+            std::tuple<const ArrayView<F>*...> m_views;
+    };
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <boost/any.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "TreeWrapper.h"
+
+namespace ROOT {
+
+    class ColumnarCache;
+
+    namespace columnar {
+
+        enum ColumnKind: uint32_t {
+            Scalar = 0,
+            Array = 1
+        };
+
+        /* Describe how a type is stored in a columnar cache file
+         * @T the type requested by the user
+         *
+         * Fixed-size types are stored as one contiguous array. `std::vector<T>` are stored as a contiguous array of
+         * elements, plus an offset array with one entry per tree entry.
+         */
+        template<typename T>
+        struct column_traits {
+            using element_type = T;
+            static constexpr ColumnKind kind = Scalar;
+        };
+
+        template<typename T>
+        struct column_traits<std::vector<T>> {
+            using element_type = T;
+            static constexpr ColumnKind kind = Array;
+        };
+
+        /* Sink appending the current value of one branch to a spill file */
+        struct ColumnSink {
+            public:
+                ColumnSink(const std::string& name, ColumnKind kind, size_t elementSize, const std::string& type);
+                virtual ~ColumnSink();
+
+                virtual void append() = 0;
+
+                std::string name;
+                std::string type;
+                ColumnKind kind;
+                size_t elementSize;
+
+                std::FILE* data = nullptr;
+                std::FILE* offsets = nullptr;
+                uint64_t elements = 0;
+        };
+
+        template<typename T>
+        struct ScalarSinkT: ColumnSink {
+            public:
+                ScalarSinkT(const std::string& name, const T& value)
+                    : ColumnSink(name, Scalar, sizeof(T), typeid(T).name()), m_value(value) {
+                    }
+
+                virtual void append() override {
+                    std::fwrite(&m_value, sizeof(T), 1, data);
+                    elements++;
+                }
+
+            private:
+                const T& m_value;
+        };
+
+        template<typename T>
+        struct ArraySinkT: ColumnSink {
+            public:
+                ArraySinkT(const std::string& name, const std::vector<T>& value)
+                    : ColumnSink(name, Array, sizeof(T), typeid(T).name()), m_value(value) {
+                    }
+
+                virtual void append() override {
+                    if (! m_value.empty())
+                        std::fwrite(m_value.data(), sizeof(T), m_value.size(), data);
+                    elements += m_value.size();
+                    std::fwrite(&elements, sizeof(uint64_t), 1, offsets);
+                }
+
+            private:
+                const std::vector<T>& m_value;
+        };
+
+        /* Per-column storage, updated from the mapped file each time an entry is loaded */
+        struct Slot {
+            public:
+                virtual ~Slot() {}
+                virtual void load(uint64_t entry) = 0;
+        };
+
+        template<typename T>
+        struct ScalarSlotT: Slot {
+            public:
+                ScalarSlotT(const char* base, const uint64_t*)
+                    : m_base(base) {
+                    }
+
+                virtual void load(uint64_t entry) override {
+                    std::memcpy(&value, m_base + entry * sizeof(T), sizeof(T));
+                }
+
+                T value = T();
+
+            private:
+                const char* m_base;
+        };
+
+        template<typename T>
+        struct ArraySlotT: Slot {
+            public:
+                ArraySlotT(const char* base, const uint64_t* offsets)
+                    : m_base(reinterpret_cast<const T*>(base)), m_offsets(offsets) {
+                    }
+
+                virtual void load(uint64_t entry) override {
+                    value.assign(m_base + m_offsets[entry], m_base + m_offsets[entry + 1]);
+                }
+
+                std::vector<T> value;
+
+            private:
+                const T* m_base;
+                const uint64_t* m_offsets;
+        };
+
+        template<typename T>
+        struct slot_for {
+            using type = ScalarSlotT<T>;
+        };
+
+        template<typename T>
+        struct slot_for<std::vector<T>> {
+            using type = ArraySlotT<T>;
+        };
+    }
+
+    /* Export a set of branches to a columnar cache file
+     *
+     * Each registered branch is stored uncompressed as one contiguous array, so that the file can later be
+     * memory-mapped by <ColumnarCache> and read without any decompression. Only trivially copyable types, and
+     * variable-sized arrays of trivially copyable types, are supported.
+     *
+     * ```
+     * ColumnarCacheWriter writer(tree);
+     * writer.add<float>("met");
+     * writer.addVarr<float, int>("jet_pt");
+     * writer.write("cache.twc");
+     * ```
+     */
+    class ColumnarCacheWriter {
+        public:
+            /* Create a new writer
+             * @tree the wrapper to read entries from. Branches are registered for reading in this wrapper.
+             */
+            ColumnarCacheWriter(TreeWrapper& tree);
+
+            /* Register a branch of fixed-size type <T> for export
+             * @name the branch name
+             */
+            template<typename T> void add(const std::string& name) {
+                static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a columnar cache");
+
+                const T& value = m_tree[name].read<T>();
+                m_sinks.emplace_back(new columnar::ScalarSinkT<T>(name, value));
+            }
+
+            /* Register a variable-sized array branch for export
+             * @T the element type
+             * @S the type of the length leaf
+             * @name the branch name
+             */
+            template<typename T, typename S> void addVarr(const std::string& name) {
+                static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a columnar cache");
+
+                const std::vector<T>& value = m_tree.varr<S>(name).template read<T>();
+                m_sinks.emplace_back(new columnar::ArraySinkT<T>(name, value));
+            }
+
+            /* Loop over the wrapper and write the cache file
+             * @path the output file path
+             *
+             * The loop starts at the current entry of the wrapper and honours <TreeWrapper::stopAt>.
+             *
+             * @return the number of entries written
+             */
+            uint64_t write(const std::string& path);
+
+        private:
+            TreeWrapper& m_tree;
+            std::vector<std::unique_ptr<columnar::ColumnSink>> m_sinks;
+    };
+
+    /* A column of a <ColumnarCache>
+     *
+     * The only way to create a CachedColumn instance is from ColumnarCache <ColumnarCache::operator[]>.
+     */
+    class CachedColumn {
+        public:
+            CachedColumn(const CachedColumn&) = delete;
+            CachedColumn& operator=(const CachedColumn&) = delete;
+
+            /* Name accessor
+             * @return the name of the column
+             */
+            const std::string& name() const { return m_name; }
+
+            /* Register this column for read access
+             * @T Type of data this column holds. Use `std::vector<T>` for variable-sized array columns.
+             *
+             * The type must match the one used when writing the cache, otherwise an exception is thrown.
+             *
+             * If an entry was already loaded, the column is filled with it right away.
+             *
+             * @return a const reference to the data hold by this column. The content will change each time <ColumnarCache::next> is called.
+             */
+            template<typename T> const T& read() {
+                using traits = columnar::column_traits<T>;
+                using element_type = typename traits::element_type;
+                using slot_type = typename columnar::slot_for<T>::type;
+
+                if (m_data.empty()) {
+                    if (traits::kind != m_kind || sizeof(element_type) != m_element_size || m_type != typeid(element_type).name())
+                        throw std::runtime_error("Column " + m_name + " was not written with the requested type");
+
+                    std::shared_ptr<columnar::Slot> slot(new slot_type(m_base, m_offsets));
+                    m_data = boost::any(slot);
+                    bind(slot.get());
+                }
+
+                return static_cast<const slot_type*>(m_slot)->value;
+            }
+
+        private:
+            friend class ColumnarCache;
+
+            CachedColumn(const ColumnarCache& cache, const std::string& name, const std::string& type, columnar::ColumnKind kind, size_t elementSize, const char* base, const uint64_t* offsets):
+                m_cache(cache),
+                m_name(name),
+                m_type(type),
+                m_kind(kind),
+                m_element_size(elementSize),
+                m_base(base),
+                m_offsets(offsets) {
+
+                }
+
+            // Set <m_slot>, and load the current entry of the cache into it
+            void bind(columnar::Slot* slot);
+
+            const ColumnarCache& m_cache;
+            std::string m_name;
+            std::string m_type;
+            columnar::ColumnKind m_kind;
+            size_t m_element_size;
+
+            const char* m_base;
+            const uint64_t* m_offsets;
+
+            boost::any m_data;
+            columnar::Slot* m_slot = nullptr;
+    };
+
+    /* Read a columnar cache file written by <ColumnarCacheWriter>
+     *
+     * The file is memory-mapped: reading an entry is only a copy from the mapped pages into the buffers returned by
+     * <CachedColumn::read>. The iteration API mirrors <TreeWrapper>.
+     */
+    class ColumnarCache {
+        public:
+            /* Open a cache file
+             * @path the file to open
+             *
+             * Throw `std::runtime_error` if the file cannot be mapped or is not a valid cache file.
+             */
+            ColumnarCache(const std::string& path);
+            ~ColumnarCache();
+
+            ColumnarCache(const ColumnarCache&) = delete;
+            ColumnarCache& operator=(const ColumnarCache&) = delete;
+
+            /* Read the next entry.
+             *
+             * @return True if the entry has been read correctly, false if the end of the cache is reached
+             */
+            bool next();
+
+            /* Read a specific entry
+             * @entry the entry to read
+             *
+             * @return True if the entry has been read correctly, false otherwise
+             */
+            bool getEntry(uint64_t entry);
+
+            /**
+             * \brief Set the entry to read next
+             */
+            void setEntry(uint64_t entry) {
+                m_entry = entry;
+            }
+
+            // Rewind to the beginning of the cache.
+            void rewind() {
+                m_entry = 0;
+            }
+
+            /* Get the number of entries in the cache
+             *
+             * @return the number of entries in the cache
+             */
+            uint64_t getEntries() const {
+                return m_entries;
+            }
+
+            /* Check if a column exists in the cache
+             * @name the column name
+             */
+            bool has(const std::string& name) const {
+                return m_columns.count(name);
+            }
+
+            /* Retrieve a column
+             * @name the column name
+             *
+             * Throw `std::runtime_error` if no column named <name> exists in the cache.
+             *
+             * @return A reference to the column. Use <CachedColumn::read> to access its data.
+             */
+            CachedColumn& operator[](const std::string& name);
+
+        private:
+            friend class CachedColumn;
+
+            std::string m_path;
+            char* m_map = nullptr;
+            size_t m_size = 0;
+
+            uint64_t m_entries = 0;
+            uint64_t m_entry = 0;
+
+            // Last entry loaded by <getEntry>, for the columns registered afterwards
+            bool m_loaded = false;
+            uint64_t m_loaded_entry = 0;
+
+            std::unordered_map<std::string, std::shared_ptr<CachedColumn>> m_columns;
+    };
+};
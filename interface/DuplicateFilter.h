@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ROOT {
+
+    /* Set of the keys already seen, to find duplicated entries
+     *
+     * A key is a tuple of 64-bit values identifying an entry. Keys are spread over independent shards according to their
+     * <hash>, each shard with its own lock, so that one filter can be shared by wrappers running on several threads.
+     *
+     * Each shard starts as an exact open-addressing table of hashes, at most three quarters full, next to a copy of the
+     * full keys: keys with the same hash are compared value by value, so that no new key is ever reported as a
+     * duplicate. When a shard would go above its share of the memory budget, it is converted to a cuckoo filter with
+     * 16-bit fingerprints, using about 2 bytes per key, and the full keys are dropped. From then on, a new key is wrongly
+     * reported as a duplicate with a probability of about 1e-4. If the cuckoo filter itself gets full, new keys are not
+     * remembered anymore: they are all reported as new, and a warning is printed.
+     */
+    class DuplicateFilter {
+        public:
+            /* Create an empty filter
+             * @memoryBudget the memory the filter may use, in bytes. 0 for no limit, in which case the filter stays exact.
+             * @shards the number of shards
+             */
+            DuplicateFilter(std::size_t memoryBudget = 0, std::size_t shards = 64);
+            ~DuplicateFilter();
+
+            DuplicateFilter(const DuplicateFilter&) = delete;
+            DuplicateFilter& operator=(const DuplicateFilter&) = delete;
+
+            /* Combine the values of a key into a 64-bit hash
+             * @values the values
+             * @count the number of values
+             *
+             * @return the hash, never 0
+             */
+            static uint64_t hash(const uint64_t* values, std::size_t count);
+
+            /* Add a key to the filter
+             * @values the values of the key
+             * @count the number of values
+             *
+             * @return true if the key was not seen before, false for a duplicate
+             */
+            bool insert(const uint64_t* values, std::size_t count);
+
+            /* Forget all the keys, and go back to the exact mode */
+            void clear();
+
+            // Number of keys inserted and reported as new
+            uint64_t size() const { return m_inserted; }
+            // Number of keys reported as duplicates
+            uint64_t duplicates() const { return m_duplicates; }
+
+            // False once a shard is converted to a cuckoo filter, and new keys may be reported as duplicates
+            bool exact() const;
+
+            // Memory used by the shards
+            std::size_t memory() const;
+
+        private:
+            struct Shard;
+
+            // Convert an exact shard to a cuckoo filter
+            void convert(Shard& shard);
+
+            std::size_t m_shard_budget;
+            std::vector<std::unique_ptr<Shard>> m_shards;
+
+            std::atomic<uint64_t> m_inserted;
+            std::atomic<uint64_t> m_duplicates;
+            std::atomic<bool> m_full_warned;
+    };
+};
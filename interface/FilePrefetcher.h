@@ -0,0 +1,45 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+class TFile;
+
+namespace ROOT {
+
+    /* Open a file in the background
+     *
+     * Used by <TreeWrapper> to open the next file of a TChain while the current one is processed. The file is opened,
+     * the tree metadata read, and the baskets of the first cluster of the given branches read, on a separate thread.
+     * Baskets are only read, not decompressed: the goal is to warm the file system and remote caches. The file is kept
+     * open until <release> is called, so that connections and caches stay warm until the TChain opens the file itself.
+     */
+    class FilePrefetcher {
+        public:
+            FilePrefetcher() = default;
+            ~FilePrefetcher();
+
+            FilePrefetcher(const FilePrefetcher&) = delete;
+            FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+            /* Start opening a file in the background
+             * @fileName the file to open
+             * @treeName the name of the tree to read from the file
+             * @branches the branches whose first cluster is read
+             *
+             * Any file previously prefetched is released first.
+             */
+            void prefetch(const std::string& fileName, const std::string& treeName, const std::vector<std::string>& branches);
+
+            /* Wait for the background task, and close the file */
+            void release();
+
+            /* Name of the file being prefetched, empty if none */
+            const std::string& fileName() const { return m_file_name; }
+
+        private:
+            std::string m_file_name;
+            std::future<TFile*> m_file;
+    };
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+namespace ROOT {
+
+    namespace utils {
+
+        /* Return and argument types of a callable: function pointer, lambda or functor
+         *
+         * Arguments are exposed without reference or cv-qualifiers, so that `arg<0>` is `float` for both `float` and
+         * `const float&` parameters. Generic lambdas are not supported.
+         */
+        template<typename F>
+        struct function_traits: function_traits<decltype(&F::operator())> {};
+
+        template<typename R, typename... A>
+        struct function_traits<R(A...)> {
+            using result_type = R;
+            static constexpr std::size_t arity = sizeof...(A);
+
+            template<std::size_t I>
+            using arg = typename std::decay<typename std::tuple_element<I, std::tuple<A...>>::type>::type;
+        };
+
+        template<typename R, typename... A>
+        struct function_traits<R(*)(A...)>: function_traits<R(A...)> {};
+
+        template<typename C, typename R, typename... A>
+        struct function_traits<R(C::*)(A...)>: function_traits<R(A...)> {};
+
+        template<typename C, typename R, typename... A>
+        struct function_traits<R(C::*)(A...) const>: function_traits<R(A...)> {};
+    }
+}
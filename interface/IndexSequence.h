@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ROOT {
+
+    namespace utils {
+
+        /* Compile-time sequence of indices, to expand tuples (`std::index_sequence` is only available in C++14) */
+        template<std::size_t... I>
+        struct index_sequence {};
+
+        template<std::size_t N, std::size_t... I>
+        struct make_index_sequence: make_index_sequence<N - 1, N - 1, I...> {};
+
+        template<std::size_t... I>
+        struct make_index_sequence<0, I...>: index_sequence<I...> {};
+    }
+}
@@ -1,13 +1,21 @@
 #pragma once
 
 #include <boost/any.hpp>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <type_traits>
 
 #include <TTree.h>
 
 #include "Brancher.h"
+#include "ClusterCache.h"
+#include "LeafHandle.h"
+#include "MemoryReport.h"
 #include "Resetter.h"
+#include "SortedFill.h"
 #include "TreeWrapperAccessor.h"
 
 namespace ROOT {
@@ -80,9 +88,39 @@ namespace ROOT {
              * @return a const reference to the data hold by this branch. The content is in read-only mode, and will change each time <TreeWrapper::next> is called.
              */
             template<typename T> const T& read() {
+                if (m_compute) {
+                    // Computed column, see <TreeWrapper::define>
+                    fetch();
+                    return const_cast<const T&>(boost::any_cast<T&>(m_data));
+                }
+
+                if (m_lazy) {
+                    // Requested directly: read it with the other branches from now on
+                    m_lazy = false;
+                    m_replay = [](Leaf& leaf) { leaf.read<T>(); };
+                    fetch();
+                }
+
+                return registerRead<T>();
+            }
+
+            /* Register this branch for read access, and get a handle on its data
+             * @T Type of data this branch holds
+             *
+             * Same as <read>, but returns a <LeafHandle>, cheap to copy and to dereference in the event loop.
+             *
+             * @return a handle on the data hold by this branch
+             */
+            template<typename T> LeafHandle<T> handle() {
+                return LeafHandle<T>(&read<T>());
+            }
+
+        private:
+            template<typename T> const T& registerRead() {
                 if (m_data.empty() && m_data_ptr == nullptr) {
 
                     m_store_class = TClass::GetClass(typeid(T)) != nullptr;
+                    m_replay = [](Leaf& leaf) { leaf.read<T>(); };
 
                     // Initialize boost::any with empty data.
                     // This allocate the necessary memory
@@ -92,13 +130,20 @@ namespace ROOT {
 
                         T* data = boost::any_cast<std::shared_ptr<T>>(m_data).get();
                         m_resetter.reset(new ResetterT<T>(*data));
+                        m_footprint = [data]() { return sizeof(T) + ROOT::utils::heapSize(*data); };
+
+                        if (std::is_trivially_copyable<T>::value) {
+                            // Content can be shared through the ClusterCache
+                            m_raw_data = data;
+                            m_raw_size = sizeof(T);
+                        }
 
                         if (m_tree.tree()) {
-                            m_branch = m_tree.tree()->GetBranch(m_name.c_str());
+                            m_branch = m_tree.branch(m_name);
                             if (m_branch) {
                                 m_tree.tree()->SetBranchAddress<T>(m_name.c_str(), data, &m_branch);
                                 // Enable read for this branch
-                                ROOT::utils::activateBranch(m_branch);
+                                m_tree.activate(m_name, m_branch);
                             } else {
                                 std::cout << "Warning: branch '" << m_name << "' not found in tree" << std::endl;
                             }
@@ -106,15 +151,21 @@ namespace ROOT {
                             m_brancher.reset(new BranchReaderT<T>(data, &m_branch));
                         }
                     } else {
-                        m_data_ptr = nullptr;
+                        // Hand ROOT an object of our own, so that the reference returned is valid before the first entry
+                        // is read. ROOT would otherwise allocate it on the first GetEntry.
+                        std::shared_ptr<T> object(new T());
+                        T* data = object.get();
+                        m_object = object;
+                        m_data_ptr = data;
                         m_data_ptr_ptr = &m_data_ptr;
+                        m_footprint = [data]() { return sizeof(T) + ROOT::utils::heapSize(*data); };
 
                         if (m_tree.tree()) {
-                            m_branch = m_tree.tree()->GetBranch(m_name.c_str());
+                            m_branch = m_tree.branch(m_name);
                             if (m_branch) {
                                 m_tree.tree()->SetBranchAddress<T>(m_name.c_str(), reinterpret_cast<T**>(m_data_ptr_ptr), &m_branch);
                                 // Enable read for this branch
-                                ROOT::utils::activateBranch(m_branch);
+                                m_tree.activate(m_name, m_branch);
                             } else {
                                 std::cout << "Warning: branch '" << m_name << "' not found in tree" << std::endl;
                             }
@@ -140,11 +191,45 @@ namespace ROOT {
                     return const_cast<const T&>(*reinterpret_cast<T*>(m_data_ptr));
             }
 
-        private:
+            /* Register this branch as an input of a computed column
+             *
+             * If the branch is not registered yet, it is not read with the other branches but only by <fetch>, when a
+             * computed column needs it.
+             */
+            template<typename T> const T& readLazy() {
+                if (m_compute)
+                    return const_cast<const T&>(boost::any_cast<T&>(m_data));
+
+                if (m_data.empty() && m_data_ptr == nullptr) {
+                    m_lazy = true;
+                    const T& data = registerRead<T>();
+                    m_replay = [](Leaf& leaf) { leaf.readLazy<T>(); };
+                    return data;
+                }
+
+                return registerRead<T>();
+            }
+
+            /* Bring the content of a lazy or computed leaf up-to-date with the current entry
+             *
+             * Does nothing for the other leafs, which are read by <TreeWrapper::getEntry>.
+             */
+            void fetch() {
+                const uint64_t serial = m_tree.serial();
+                if (m_fetched == serial)
+                    return;
+                m_fetched = serial;
+
+                if (m_compute)
+                    m_compute();
+                else if (m_lazy && m_branch)
+                    m_branch->GetEntry(m_tree.localEntry());
+            }
+
             void init(const TreeWrapperAccessor& tree) {
                 m_tree = tree;
                 if (m_brancher.get())
-                    (*m_brancher)(m_name, m_tree.tree());
+                    (*m_brancher)(m_name, m_tree);
             }
 
             void reset() {
@@ -157,8 +242,26 @@ namespace ROOT {
                 return m_branch;
             }
 
+            // Memory used by the data of this leaf
+            size_t bufferSize() const {
+                return m_footprint ? m_footprint() : 0;
+            }
+
+            /* Read an entry through the process-wide <ClusterCache>
+             * @entry the entry to read, local to the current tree
+             * @owner the owner the decoded cluster is charged to, see <ClusterCache::newOwner>
+             *
+             * The whole cluster containing <entry> is decoded and stored in the cache if no other reader did it already.
+             * Only valid if <m_raw_data> is set.
+             *
+             * @return the same as `TBranch::GetEntry`
+             */
+            int getCachedEntry(int64_t entry, uint64_t owner);
+
             template<typename T, typename... P> T& write_internal(bool transient, bool autoReset, P&&... parameters) {
                 if (m_data.empty()) {
+                    m_tree.registerWrite(m_name);
+
                     // Initialize boost::any with empty data.
                     // This allocate the necessary memory
                     if (sizeof...(parameters) != 0) {
@@ -169,15 +272,30 @@ namespace ROOT {
                     }
 
                     T& data = boost::any_cast<T&>(m_data);
+
+                    if (sizeof...(parameters) != 0) {
+                        // Replay with a copy of the initial value
+                        T initial(data);
+                        m_replay = [transient, initial](Leaf& leaf) { leaf.write_internal<T>(transient, false, T(initial)); };
+                    } else {
+                        m_replay = [transient, autoReset](Leaf& leaf) { leaf.write_internal<T>(transient, autoReset); };
+                    }
                     if (autoReset)
                         m_resetter.reset(new ResetterT<T>(data));
 
+                    T* data_ptr = &data;
+                    m_footprint = [data_ptr]() { return sizeof(T) + ROOT::utils::heapSize(*data_ptr); };
+                    m_snapshot = [data_ptr]() { return std::unique_ptr<SnapshotColumn>(new SnapshotColumnT<T>(*data_ptr)); };
+                    m_numeric = numericValue(data_ptr, std::integral_constant<bool, std::is_arithmetic<T>::value>());
+
                     if (! transient) {
                         if (m_tree.tree()) {
                             // Register this Leaf in the tree
-                            m_branch = m_tree.tree()->Branch<T>(m_name.c_str(), &data);
+                            const BranchOptions& options = m_tree.branchOptions(m_name);
+                            m_branch = m_tree.tree()->Branch<T>(m_name.c_str(), &data, options.basketSize, options.splitLevel);
+                            ROOT::utils::applyBranchOptions(m_branch, options);
                         } else {
-                            m_brancher.reset(new BranchCreaterT<T>(data, &m_branch));
+                            m_brancher.reset(new BranchCreaterT<T>(data, &m_branch, m_tree.branchOptions(m_name)));
                         }
                     }
                 }
@@ -185,6 +303,23 @@ namespace ROOT {
                 return boost::any_cast<T&>(m_data);
             }
 
+            template<typename T> static std::function<void(double&, double&)> numericValue(const T* data, std::true_type) {
+                return [data](double& low, double& high) {
+                    low = high = static_cast<double>(*data);
+
+                    // Integers above 2^53 are rounded to the nearest double: the value is within one ulp on either side
+                    if (std::is_integral<T>::value && std::numeric_limits<T>::digits > std::numeric_limits<double>::digits &&
+                            std::abs(low) >= 9007199254740992.0) {
+                        low = std::nextafter(low, -std::numeric_limits<double>::infinity());
+                        high = std::nextafter(high, std::numeric_limits<double>::infinity());
+                    }
+                };
+            }
+
+            template<typename T> static std::function<void(double&, double&)> numericValue(const T*, std::false_type) {
+                return nullptr;
+            }
+
             Leaf(const Leaf&) = delete;
             Leaf& operator=(const Leaf&) = delete;
 
@@ -200,12 +335,42 @@ namespace ROOT {
 
             TBranch* m_branch = nullptr;
 
+            // Set for trivially copyable types only
+            void* m_raw_data = nullptr;
+            size_t m_raw_size = 0;
+
+            std::shared_ptr<const ClusterBlock> m_block;
+            TTree* m_block_tree = nullptr;
+
             std::string m_name;
             TreeWrapperAccessor m_tree;
 
+            // Owner of the object pointed by <m_data_ptr>
+            std::shared_ptr<void> m_object;
+
             std::unique_ptr<Resetter> m_resetter;
             std::unique_ptr<Brancher> m_brancher;
 
+            // Register the same type and access mode on another leaf. Used by <TreeWrapper::cloneFor>.
+            std::function<void(Leaf&)> m_replay;
+
+            // Compute <bufferSize>, knowing the type of the data
+            std::function<size_t()> m_footprint;
+
+            // Copy the write buffer, for <TreeWrapper::setSortedFill>. Set in write mode only.
+            std::function<std::unique_ptr<SnapshotColumn>()> m_snapshot;
+
+            // Doubles surrounding the value of the write buffer, equal if it is exact, for <TreeWrapper::recordClusterStats>.
+            // Set for arithmetic types only.
+            std::function<void(double&, double&)> m_numeric;
+
+            // Not read by <TreeWrapper::getEntry>, only on demand by <fetch>
+            bool m_lazy = false;
+            // Evaluate a computed column. Set by <TreeWrapper::define>.
+            std::function<void()> m_compute;
+            // Serial number of the entry last fetched, see <TreeWrapperAccessor::serial>
+            uint64_t m_fetched = uint64_t(-1);
+
             bool m_store_class;
     };
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+namespace ROOT {
+    class Leaf;
+
+    /* A typed, read-only handle on the data of a branch
+     * @T the type of data the branch holds
+     *
+     * The handle is only a pointer to the buffer the branch is read into: dereferencing it does not involve any lookup,
+     * unlike calling `tree["x"].read<T>()` again. Retrieve handles once, before the event loop, and copy them freely.
+     *
+     * ```
+     * auto pt = tree.handle<float>("pt");
+     * while (tree.next()) {
+     *     h->Fill(*pt);
+     * }
+     * ```
+     *
+     * A handle stays valid as long as the <TreeWrapper> it comes from, including across the files of a TChain. Handles
+     * are not transferred by <TreeWrapper::cloneFor>.
+     */
+    template<typename T>
+    class LeafHandle {
+        public:
+            // An empty handle, pointing to nothing
+            LeafHandle() = default;
+
+            const T& operator*() const { return *m_data; }
+            const T* operator->() const { return m_data; }
+            const T* get() const { return m_data; }
+
+            explicit operator bool() const { return m_data != nullptr; }
+
+        private:
+            friend class Leaf;
+
+            explicit LeafHandle(const T* data):
+                m_data(data) {
+
+                }
+
+            const T* m_data = nullptr;
+    };
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class TBranch;
+
+namespace ROOT {
+
+    namespace utils {
+        /* Heap memory owned by a value, on top of sizeof(T)
+         *
+         * Only `std::vector` and `std::string`, possibly nested, are followed. Any other type is assumed to own
+         * no heap memory.
+         */
+        template<typename T> std::size_t heapSize(const T&) {
+            return 0;
+        }
+
+        inline std::size_t heapSize(const std::string& value) {
+            return value.capacity();
+        }
+
+        template<typename T> std::size_t heapSize(const std::vector<T>& value) {
+            std::size_t size = value.capacity() * sizeof(T);
+            for (const auto& item: value)
+                size += heapSize(item);
+
+            return size;
+        }
+
+        /* Memory used by the baskets currently loaded for a branch and its sub-branches
+         * @branch the branch
+         */
+        std::size_t basketMemory(TBranch* branch);
+    }
+
+    /* Memory used by one branch of a <TreeWrapper> */
+    struct BranchMemory {
+        std::string name;
+
+        // User-facing buffer: the value, or the reserved capacity for arrays
+        std::size_t buffer = 0;
+        // Baskets currently held in memory by ROOT
+        std::size_t baskets = 0;
+
+        std::size_t total() const { return buffer + baskets; }
+    };
+
+    /* Memory footprint of a <TreeWrapper>, as returned by <TreeWrapper::memoryReport>
+     *
+     * All sizes are in bytes.
+     */
+    struct MemoryReport {
+        // Sorted by decreasing total size
+        std::vector<BranchMemory> branches;
+
+        std::size_t buffers = 0;
+        std::size_t baskets = 0;
+        std::size_t treeCache = 0;
+        // Size of the blocks of the process-wide cluster cache decoded by the wrapper (see <TreeWrapper::setSharedCache>)
+        std::size_t clusterCache = 0;
+
+        // The budget set with <TreeWrapper::setMemoryBudget>, or 0
+        std::size_t budget = 0;
+
+        std::size_t total() const {
+            return buffers + baskets + treeCache + clusterCache;
+        }
+
+        /* Print the report
+         * @out the stream to print to
+         * @maxBranches the number of branches to list, biggest first
+         */
+        void print(std::ostream& out = std::cout, std::size_t maxBranches = 20) const;
+    };
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <TH1.h>
+
+namespace ROOT {
+
+    namespace parallel {
+        // Bytes of padding around per-thread buffers, so that two threads never write to the same cache line
+        static const std::size_t kCacheLine = 64;
+
+        /* Identifier of a <ThreadSlots> instance
+         *
+         * <index> is the position of the instance in the thread-local tables, and is reused once the instance is
+         * destroyed. <serial> is never reused: it tells a slot left by a destroyed instance from a slot of the current one.
+         */
+        struct SlotId {
+            std::size_t index;
+            uint64_t serial;
+        };
+
+        /* Allocate an identifier for a <ThreadSlots> instance, reusing the index of a released one if any */
+        SlotId newSlotId();
+
+        /* Give back the index of <id>, once its <ThreadSlots> instance is destroyed */
+        void releaseSlotId(const SlotId& id);
+
+        /* Slot of the calling thread for a <ThreadSlots> instance
+         * @id the identifier of the instance
+         *
+         * @return a reference to the slot pointer, null if the thread did not use this instance yet. Only the calling
+         * thread has access to it, so no synchronisation is needed.
+         */
+        void*& threadSlot(const SlotId& id);
+    }
+
+    /* One instance of <T> per thread
+     * @T the type of the per-thread object
+     *
+     * The first call to <local> from a thread creates its object, under a lock. All the following calls from the same
+     * thread only read a thread-local pointer. Objects are kept until the ThreadSlots instance is destroyed, so that
+     * they can be combined with <forEach> once all the threads are done.
+     */
+    template<typename T>
+    class ThreadSlots {
+        public:
+            /* Create the set of slots
+             * @factory called once per thread to create its object
+             */
+            ThreadSlots(std::function<std::unique_ptr<T>()> factory):
+                m_id(parallel::newSlotId()),
+                m_factory(factory) {
+
+                }
+
+            ~ThreadSlots() {
+                parallel::releaseSlotId(m_id);
+            }
+
+            ThreadSlots(const ThreadSlots&) = delete;
+            ThreadSlots& operator=(const ThreadSlots&) = delete;
+
+            /* Object of the calling thread */
+            T& local() {
+                void*& slot = parallel::threadSlot(m_id);
+                if (! slot)
+                    slot = create();
+
+                return *static_cast<T*>(slot);
+            }
+
+            /* Call <f> on the object of each thread
+             *
+             * Must not be called while other threads are still using <local>.
+             */
+            void forEach(const std::function<void(T&)>& f) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& slot: m_slots)
+                    f(*slot);
+            }
+
+            /* Number of threads which used this instance */
+            std::size_t size() const {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_slots.size();
+            }
+
+        private:
+            T* create() {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_slots.push_back(m_factory());
+
+                return m_slots.back().get();
+            }
+
+            parallel::SlotId m_id;
+            std::function<std::unique_ptr<T>()> m_factory;
+
+            mutable std::mutex m_mutex;
+            std::vector<std::unique_ptr<T>> m_slots;
+    };
+
+    /* Fill a histogram from several threads
+     * @H the histogram class
+     *
+     * Each thread fills its own clone of the model histogram, without any lock or atomic operation. The clones are
+     * summed by <merge> once the loop is over. Cloning a histogram while other threads use ROOT requires
+     * `ROOT::EnableThreadSafety()`.
+     *
+     * ```
+     * ParallelHistogram<TH1F> h_pt(TH1F("pt", "pt", 100, 0, 200));
+     * // In each worker
+     * h_pt.fill(pt);
+     * // Once all the workers are done
+     * std::unique_ptr<TH1F> pt = h_pt.merge();
+     * ```
+     */
+    template<typename H = TH1>
+    class ParallelHistogram {
+        public:
+            /* Create the histogram
+             * @model the histogram to clone for each thread. It is copied, and can be destroyed afterwards.
+             */
+            ParallelHistogram(const H& model):
+                m_name(model.GetName()),
+                m_model(clone(model, m_name + "_model")),
+                m_slots([this]() {
+                        // Called under the lock of m_slots
+                        return clone(*m_model, m_name + "_" + std::to_string(m_clones++));
+                        }) {
+
+                }
+
+            /* Fill the histogram of the calling thread
+             * @value the value
+             * @weight the weight
+             */
+            void fill(double value, double weight = 1) {
+                m_slots.local().Fill(value, weight);
+            }
+
+            /* Histogram of the calling thread, for the other filling methods of ROOT histograms */
+            H& local() {
+                return m_slots.local();
+            }
+
+            /* Sum the histograms of all the threads
+             * @name the name of the result. The name of the model is used if empty.
+             *
+             * Must be called once all the threads are done filling.
+             *
+             * @return a new histogram, not attached to any directory
+             */
+            std::unique_ptr<H> merge(const std::string& name = "") {
+                std::unique_ptr<H> result(clone(*m_model, name.empty() ? m_name : name));
+                m_slots.forEach([&result](H& h) { result->Add(&h); });
+
+                return result;
+            }
+
+        private:
+            static std::unique_ptr<H> clone(const H& h, const std::string& name) {
+                std::unique_ptr<H> result(static_cast<H*>(h.Clone(name.c_str())));
+                result->SetDirectory(nullptr);
+
+                return result;
+            }
+
+            std::string m_name;
+            std::unique_ptr<H> m_model;
+
+            std::size_t m_clones = 0;
+
+            ThreadSlots<H> m_slots;
+    };
+
+    /* Weighted sums in fixed-width bins, filled from several threads
+     *
+     * A lightweight alternative to <ParallelHistogram> when the result is not needed as a ROOT histogram. Bin 0 is the
+     * underflow, bin <nBins> + 1 the overflow, like for `TH1`. Each thread accumulates into its own padded buffer.
+     */
+    class ParallelBins {
+        public:
+            /* Create the bins
+             * @nBins the number of bins between <min> and <max>
+             * @min the lower edge of the first bin
+             * @max the upper edge of the last bin
+             */
+            ParallelBins(std::size_t nBins, double min, double max);
+
+            /* Add <weight> to the bin containing <value>
+             * @value the value
+             * @weight the weight
+             */
+            void fill(double value, double weight = 1) {
+                m_slots.local().sums[bin(value)] += weight;
+            }
+
+            /* Sum the bins of all the threads
+             *
+             * Must be called once all the threads are done filling.
+             *
+             * @return the content of each bin, including underflow and overflow
+             */
+            std::vector<double> merge();
+
+            /* Index of the bin containing <value> */
+            std::size_t bin(double value) const {
+                if (! (value >= m_min))
+                    return 0;
+                if (value >= m_max)
+                    return m_bins + 1;
+
+                // Rounding can give <m_bins> for a value just below <m_max>
+                return 1 + std::min(static_cast<std::size_t>((value - m_min) * m_scale), m_bins - 1);
+            }
+
+        private:
+            struct Slot {
+                Slot(std::size_t nBins);
+
+                std::vector<double> storage;
+                double* sums;
+            };
+
+            std::size_t m_bins;
+            double m_min;
+            double m_max;
+            double m_scale;
+
+            ThreadSlots<Slot> m_slots;
+    };
+
+    /* A counter incremented from several threads
+     *
+     * Only the calling thread writes to its own counter. The counts are summed by <merge>.
+     */
+    template<typename T = uint64_t>
+    class ParallelCounter {
+        public:
+            ParallelCounter():
+                m_slots([]() { return std::unique_ptr<Slot>(new Slot()); }) {
+
+                }
+
+            void add(T value = 1) {
+                m_slots.local().value += value;
+            }
+
+            /* Sum the counters of all the threads
+             *
+             * Must be called once all the threads are done counting.
+             */
+            T merge() {
+                T total = T();
+                m_slots.forEach([&total](Slot& slot) { total += slot.value; });
+
+                return total;
+            }
+
+        private:
+            struct Slot {
+                char before[parallel::kCacheLine];
+                T value = T();
+                char after[parallel::kCacheLine];
+            };
+
+            ThreadSlots<Slot> m_slots;
+    };
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "MemoryReport.h"
+
+namespace ROOT {
+
+    namespace utils {
+        // True if two <T> can be compared with operator<
+        template<typename T, typename = void>
+        struct is_less_comparable: std::false_type {};
+
+        template<typename T>
+        struct is_less_comparable<T, decltype(void(std::declval<const T&>() < std::declval<const T&>()))>: std::true_type {};
+    }
+
+    /* Copies of the content of one write buffer, one per buffered entry */
+    struct SnapshotColumn {
+        public:
+            virtual ~SnapshotColumn() {}
+
+            // Append the current content of the buffer
+            virtual void save() = 0;
+            // Copy the entry <index> back into the buffer
+            virtual void restore(std::size_t index) = 0;
+            virtual void clear() = 0;
+            // Compare two saved entries. Throw `std::runtime_error` if the type has no operator<.
+            virtual bool less(std::size_t a, std::size_t b) const = 0;
+            // Memory used by the saved entries
+            virtual std::size_t memory() const = 0;
+    };
+
+    template<typename T>
+    struct SnapshotColumnT: SnapshotColumn {
+        public:
+            SnapshotColumnT(T& data):
+                m_data(data) {
+
+                }
+
+            virtual void save() override {
+                m_values.push_back(m_data);
+            }
+
+            virtual void restore(std::size_t index) override {
+                m_data = m_values[index];
+            }
+
+            virtual void clear() override {
+                m_values.clear();
+            }
+
+            virtual bool less(std::size_t a, std::size_t b) const override {
+                return compare(a, b, ROOT::utils::is_less_comparable<T>());
+            }
+
+            virtual std::size_t memory() const override {
+                std::size_t size = m_values.capacity() * sizeof(T);
+                for (const T& value: m_values)
+                    size += ROOT::utils::heapSize(value);
+
+                return size;
+            }
+
+        private:
+            bool compare(std::size_t a, std::size_t b, std::true_type) const {
+                return m_values[a] < m_values[b];
+            }
+
+            bool compare(std::size_t, std::size_t, std::false_type) const {
+                throw std::runtime_error("Branch type cannot be used as a sorting key: no operator< defined");
+            }
+
+            T& m_data;
+            std::vector<T> m_values;
+    };
+
+    /* Buffer of entries waiting to be written in key order
+     *
+     * Each buffered entry is a copy of the write buffers of all the registered branches. When the buffer is flushed, the
+     * entries are sorted by the key columns, compared in order (the second key only separates entries with the same
+     * first key, and so on), and copied back into the write buffers one after the other to be filled. Entries with the
+     * same keys keep their arrival order. See <TreeWrapper::setSortedFill>.
+     */
+    class SortedFill {
+        public:
+            /* Create the buffer
+             * @capacity the number of entries buffered before flushing
+             * @keys the names of the sorting keys
+             */
+            SortedFill(std::size_t capacity, const std::vector<std::string>& keys);
+
+            // Warn if entries are never written
+            ~SortedFill();
+
+            SortedFill(const SortedFill&) = delete;
+            SortedFill& operator=(const SortedFill&) = delete;
+
+            /* Set the columns holding the entries. Only allowed while the buffer is empty.
+             * @columns one column per write buffer
+             * @keys the position in <columns> of each sorting key
+             */
+            void setColumns(std::vector<std::unique_ptr<SnapshotColumn>> columns, const std::vector<std::size_t>& keys);
+
+            // Save the current content of the write buffers
+            void save();
+
+            /* Write the buffered entries in key order
+             * @fill called once per entry, after the write buffers hold its content
+             *
+             * Once done, the write buffers hold the last saved entry again, and the buffer is empty.
+             */
+            void flush(const std::function<void()>& fill);
+
+            std::size_t size() const { return m_size; }
+            std::size_t capacity() const { return m_capacity; }
+            bool empty() const { return m_size == 0; }
+            bool full() const { return m_size >= m_capacity; }
+
+            const std::vector<std::string>& keys() const { return m_keys; }
+
+            // Memory used by the buffered entries
+            std::size_t memory() const;
+
+        private:
+            std::size_t m_capacity;
+            std::size_t m_size = 0;
+
+            std::vector<std::string> m_keys;
+            std::vector<std::size_t> m_key_columns;
+
+            std::vector<std::unique_ptr<SnapshotColumn>> m_columns;
+    };
+};
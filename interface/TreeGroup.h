@@ -2,15 +2,29 @@
 
 #include <string>
 
+#include "Leaf.h"
+
 namespace ROOT {
     class TreeWrapper;
-    class Leaf;
 
     class TreeGroup {
         friend class TreeWrapper;
 
         public:
             Leaf& operator[](const std::string& name);
+
+            /* Register a branch of the group for read access, and get a handle on its data
+             * @T Type of data this branch holds
+             * @name the name of the branch, without the group prefix
+             *
+             * The prefix is only resolved here, not each time the handle is used.
+             *
+             * @return a handle on the data hold by the branch. See <Leaf::handle>.
+             */
+            template<typename T> LeafHandle<T> handle(const std::string& name) {
+                return (*this)[name].handle<T>();
+            }
+
             TreeGroup group(const std::string& prefix) const;
 
             TreeGroup(const TreeGroup& o);
@@ -1,11 +1,28 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
 #include <memory>
 #include <unordered_map>
-
+#include <utility>
+#include <vector>
+
+#include "BranchIndex.h"
+#include "Checkpoint.h"
+#include "ClusterStats.h"
+#include "DuplicateFilter.h"
+#include "FilePrefetcher.h"
+#include "FunctionTraits.h"
+#include "IndexSequence.h"
 #include "Leaf.h"
+#include "MemoryReport.h"
+#include "SortedFill.h"
 #include "TreeGroup.h"
 #include "VarrGroup.h"
+#include "WritePolicy.h"
 
 #include <TBranchElement.h>
 
@@ -44,6 +61,27 @@ namespace ROOT {
             /* Move constructor */
             TreeWrapper(TreeWrapper&& o);
 
+            ~TreeWrapper();
+
+            /* Create an independent wrapper with the same schema, bound to another tree.
+             * @tree The tree to wrap. Must not be null.
+             * @friends The trees to use for the friends of this wrapper, in the order they were added with <addFriend>.
+             *
+             * All the registered branches are registered again in the new wrapper, with the same types and access modes
+             * (<Leaf::read>, <Leaf::write>, ...), including the branches of the VarrGroups and of the friends. Unlike the copy
+             * constructor, nothing is shared with this wrapper: the new wrapper has its own buffers, and its own iteration
+             * state. This is the building block to run one wrapper per thread.
+             *
+             * Branches created with <Leaf::write_with_init> are initialized with a copy of their initial value. The reading
+             * settings (parallel read, file preopening, memory budget, follow mode, ...) are applied to the new wrapper too.
+             *
+             * Throw `std::runtime_error` if fewer friend trees than friends are given, or if this wrapper follows its tree
+             * and <tree> is a TChain.
+             *
+             * @return the new wrapper. References returned by <Leaf::read> or <Leaf::write> must be retrieved again from it.
+             */
+            std::unique_ptr<TreeWrapper> cloneFor(TTree* tree, const std::vector<TTree*>& friends = std::vector<TTree*>()) const;
+
             /* Wrap the tree.
              * @tree The tree to wrap. Must not be null.
              *
@@ -53,6 +91,29 @@ namespace ROOT {
              * */
             void init(TTree* tree);
 
+            /* Add a friend tree, aligned by entry number.
+             * @tree The friend tree. Must not be null, and must have at least as many entries as the wrapped tree.
+             * @alias If not empty, branches of the friend can be accessed with <operator[]> as `alias.branch`
+             *
+             * Branches of the friend are available through the same <operator[]> as the branches of the wrapped tree. A branch
+             * name not found in the wrapped tree is looked up in the friends, in the order they were added.
+             *
+             * The friend is only read when at least one of its branches is registered.
+             */
+            void addFriend(TTree* tree, const std::string& alias = "");
+
+            /* Add a friend tree, aligned by an index.
+             * @tree The friend tree. Must not be null.
+             * @alias If not empty, branches of the friend can be accessed with <operator[]> as `alias.branch`
+             * @major Name of the leaf holding the major key. It must exist in both trees.
+             * @minor Name of the leaf holding the minor key, if any. It must exist in both trees.
+             *
+             * For each entry of the wrapped tree, the entry of the friend with the same (major, minor) key is read. An index is
+             * built on the friend if it does not already have one. If no entry of the friend matches, branches of the friend
+             * are reset to their default value.
+             */
+            void addFriend(TTree* tree, const std::string& alias, const std::string& major, const std::string& minor = "");
+
             /* Read the next entry of the tree.
              *
              * @param readall if true, read all branches of the tree instead only the selected ones
@@ -81,9 +142,142 @@ namespace ROOT {
              **/
             void stopAt(uint64_t entry);
 
-            // Rewind to the beginning of the tree.
+            /* Share decoded clusters with other wrappers of the process
+             * @enable if true, fixed-size branches are read through the process-wide <ClusterCache>
+             *
+             * Each cluster of a branch is decompressed only once per process, whatever the number of wrappers reading the
+             * same file. Use `ClusterCache::instance().setMaxSize()` to bound the memory used by the cache. The blocks
+             * decoded by this wrapper are charged to it, see <setMemoryBudget>. Trees which are not backed by a file are
+             * read directly.
+             */
+            void setSharedCache(bool enable) {
+                m_shared_cache = enable;
+            }
+
+            /* Follow a tree which is still being written by another process
+             * @enable if true, <next> waits for new entries instead of returning false at the end of the tree
+             * @pollMs the delay between two checks for new entries, in milliseconds. At least 10 ms are used.
+             * @timeoutMs <next> returns false if no new entry shows up during this delay, in milliseconds. 0 to wait forever.
+             *
+             * New entries are found with `TTree::Refresh`, which reloads the tree metadata from the file: the writer must
+             * save the tree regularly (`TTree::AutoSave("SaveSelf")` or `TTree::Write`) for them to become visible. Only
+             * the new entries are read. Not available for a TChain, nor when <stopAt> has been called. The shared cluster
+             * cache (<setSharedCache>) is bypassed while following, since the last cluster can still grow.
+             */
+            void follow(bool enable, unsigned int pollMs = 1000, unsigned int timeoutMs = 0);
+
+            /* Make a <next> waiting in follow mode return false
+             *
+             * Can be called from any thread, or from a signal handler.
+             */
+            void stopFollowing() {
+                m_stop_following = true;
+            }
+
+            /* Save the iteration state regularly, so that an interrupted job can <resume>
+             * @path the checkpoint file
+             * @intervalSeconds the minimal delay between two saves
+             * @save optional callback, called with a stream to save the state of the user accumulators
+             *
+             * The state is saved by <next> when a new cluster is entered, if the last save is older than
+             * <intervalSeconds>. All the entries of the previous clusters have then been processed, and <save> is called
+             * at that point too. The state is saved again when the end of the loop is reached. The file is replaced
+             * atomically, see <Checkpoint::write>. Pass an empty path to disable checkpointing.
+             */
+            void setCheckpoint(const std::string& path, unsigned int intervalSeconds = 60, std::function<void(std::ostream&)> save = nullptr);
+
+            /* Resume an interrupted loop from a checkpoint file
+             * @path the checkpoint file, written by <setCheckpoint>
+             * @restore optional callback, called with a stream holding the data written by the save callback
+             *
+             * The next entry to read and the last entry (see <stopAt> and <shard>) are restored. Throw
+             * `std::runtime_error` if the file is invalid, was written for another file or chain of files, or for a tree
+             * with another number of entries (fewer only, in <follow> mode), or if the restored entries are beyond the
+             * end of the tree.
+             *
+             * The keys seen by <removeDuplicates> are not saved in the checkpoint, so the entries after the checkpoint
+             * could not be checked against the ones before. The two cannot be combined: throw `std::runtime_error` if
+             * <removeDuplicates> is enabled.
+             *
+             * @return false if the file does not exist, in which case nothing is changed
+             */
+            bool resume(const std::string& path, std::function<void(std::istream&)> restore = nullptr);
+
+            /* Restrict the loop to one shard of the tree.
+             * @index the index of the shard, between 0 and <count> - 1
+             * @count the total number of shards
+             *
+             * The tree is split in <count> contiguous ranges of entries. Ranges are aligned on clusters, so that no basket is
+             * read by two shards, and are balanced by the compressed size of the registered branches (of all the branches if
+             * none is registered yet) rather than by the number of entries. For a TChain, every file is opened to read its
+             * cluster and basket layout.
+             *
+             * The entry to read next and the last entry are set accordingly, see <setEntry> and <stopAt>.
+             *
+             * @return the range of entries [first, last) of the shard. It can be empty if there are more shards than clusters.
+             */
+            std::pair<uint64_t, uint64_t> shard(size_t index, size_t count);
+
+            /* Open the next file of a TChain in the background
+             * @enable if true, the next file of the chain is opened on a separate thread while the current one is processed
+             * @fraction the fraction of the current file after which the next file is opened
+             *
+             * Opening the file, reading its metadata and the first cluster of the registered branches then overlaps with
+             * the processing of the end of the current file, which reduces the latency at each file switch. See
+             * <FilePrefetcher>. Has no effect if the wrapped tree is not a TChain. Enabling it turns on ROOT thread safety.
+             */
+            void setPreopenNextFile(bool enable, double fraction = 0.9);
+
+            /* Decompress the branches of a new cluster concurrently
+             * @threads the size of the ROOT implicit multi-threading pool. 0 disables parallel reading.
+             *
+             * Each time <next> or <getEntry> enters a new cluster, the entry is read with `TTree::GetEntry`, which
+             * reads and decompresses the registered branches in parallel when ROOT implicit multi-threading is enabled,
+             * taking the locks needed to share the file and the TTreeCache. The first entry of a cluster is the one
+             * which decompresses the baskets; the following entries are read branch by branch as usual. This helps
+             * loops which cannot be split by entries, when each entry has many heavy branches.
+             *
+             * Enabling it calls `ROOT::EnableImplicitMT(threads)`, which is process-wide: the first call sets the size of
+             * the pool for the whole process.
+             */
+            void setParallelRead(size_t threads);
+
+            /* Statistics of the branch index
+             *
+             * Branches are looked up through a <BranchIndex>, built once per tree. Use this to check the time spent
+             * building it, and how often the schema of the previous file of a TChain could be reused.
+             */
+            const BranchIndex::Stats& branchIndexStats() const {
+                return m_branch_index.stats();
+            }
+
+            /* Compute the memory footprint of the wrapper
+             *
+             * The report lists the buffers of every registered branch (including the reserved capacity of variable-sized
+             * arrays), the baskets currently held in memory by ROOT for these branches, the size of the TTreeCache, the
+             * objects read through a TClass and, if <setSharedCache> is enabled, the process-wide <ClusterCache>.
+             * Branches of the friends are included, prefixed by their alias.
+             *
+             * @return the report. Use <MemoryReport::print> to display it.
+             */
+            MemoryReport memoryReport();
+
+            /* Keep the memory used by the wrapper under a budget
+             * @bytes the budget, in bytes. 0 disables it.
+             *
+             * The footprint is checked each time a new cluster is entered. When it is above the budget, the TTreeCache is
+             * shrunk first, then the share of the <ClusterCache> used by the blocks this wrapper decoded, leaving the
+             * blocks of the other wrappers alone. Finally ROOT is told to retain fewer baskets
+             * (`TTree::SetMaxVirtualSize`, applied to each tree of a TChain) and the baskets in memory are dropped. If this is still not enough, a warning is
+             * printed once, together with the <memoryReport>, to point at the branches responsible.
+             */
+            void setMemoryBudget(size_t bytes);
+
+            // Rewind to the beginning of the tree. See <removeDuplicates> for the keys already seen.
             void rewind() {
                 m_entry = -1;
+                if (m_duplicate_filter)
+                    rewindDuplicates();
             }
 
             /* Fill the tree.
@@ -92,11 +286,144 @@ namespace ROOT {
              * Fill the tree. If <reset> is true, all the branches will be resetted to their default value. See <ResetterT> for more details about the reset procedure.
              */
             void fill(bool reset = true) {
-                m_tree->Fill();
+                if (m_sorted_fill)
+                    bufferEntry();
+                else
+                    fillEntry();
+
                 if (reset)
                     this->reset();
             }
 
+            /* Write the entries in the order of some keys rather than in the order they are filled
+             * @entries the number of entries buffered before they are sorted and written. 0 disables sorting.
+             * @keys the names of the branches to sort on, most significant first. For example `{"run", "event"}`.
+             *
+             * Each <fill> copies the content of all the registered branches into a buffer, instead of filling the tree.
+             * Once <entries> are buffered, they are sorted by the keys and written to the tree. Grouping similar entries
+             * improves the compression, and makes selections on the keys touch fewer clusters. Use a multiple of the
+             * number of entries per cluster (`TTree::SetAutoFlush`) for <entries>, so that batches are not split
+             * between clusters. Memory grows with <entries> times the size of an entry, see <memoryReport>.
+             *
+             * Keys must be branches registered with <Leaf::write> or <Leaf::transient_write>, with a type providing
+             * operator<. Entries with the same keys keep their order. Only <fill> is buffered, not <fillBranches>.
+             * Registering a branch for write while entries are buffered throws `std::runtime_error`, since they would
+             * have no value for it: register all the branches before the first <fill>, or <flush> first.
+             *
+             * <flush> must be called once the last entry is filled, before writing the tree. Entries still buffered
+             * are otherwise lost, and a warning is printed. Throw `std::runtime_error` if entries are already buffered.
+             */
+            void setSortedFill(size_t entries, const std::vector<std::string>& keys);
+
+            /* Write the entries buffered by <setSortedFill>, and store the statistics of <recordClusterStats>
+             *
+             * Call it once the last entry is filled, before writing the tree. Does nothing if neither is enabled.
+             */
+            void flush();
+
+            /* Record the range of values of some branches in each cluster
+             * @branches the names of the branches, registered with <Leaf::write> for a numeric type, or the length
+             *  leaves of groups written with <VarrLeaf::write>
+             * @granularity the number of entries per block of statistics, see <ClusterStatsRecorder>
+             *
+             * The minimum, maximum and number of NaN values of each branch are recorded for each cluster, and stored by
+             * <flush> in the user info of the tree, see <ClusterStats>. Readers can then skip clusters with
+             * <addClusterPredicate>. The statistics are exact when the number of entries per cluster
+             * (`TTree::SetAutoFlush`) is a multiple of <granularity>.
+             *
+             * Throw `std::runtime_error` at the first <fill> if a branch is not registered for write with a numeric type.
+             */
+            void recordClusterStats(const std::vector<std::string>& branches, size_t granularity = 1000);
+
+            /* Skip the clusters where no entry can satisfy a condition
+             * @expression a condition on a branch, like `nJet >= 4` or `met > 200`. See <ClusterPredicate::parse>.
+             *
+             * Uses the statistics stored by <recordClusterStats> when the tree was written: <next> jumps over the clusters
+             * whose range of values proves that no entry satisfies the condition, without reading them. Conditions
+             * added with several calls must all be satisfied. Clusters and files without statistics for the branch are
+             * read normally.
+             *
+             * This is only an optimization: the entries returned by <next> do not necessarily satisfy the condition,
+             * which must still be applied in the event loop.
+             *
+             * Throw `std::runtime_error` if the expression is not valid.
+             */
+            void addClusterPredicate(const std::string& expression);
+
+            /* Remove all the conditions added with <addClusterPredicate> */
+            void clearClusterPredicates();
+
+            /* Skip the entries whose key was already seen
+             * @keys the names of the integer leaves identifying an entry, for example `{"run", "lumi", "event"}`
+             * @filter the set of keys already seen. A new one, without memory limit, is created if null.
+             *
+             * For each entry, <next> reads the key leaves first, with `TLeaf::GetValueLong64`, and checks the key
+             * against <filter>. Entries with a key already seen are skipped before any other branch is read: only the
+             * first occurrence of each key is returned, across all the files of a TChain. If the filter was created
+             * here, it is cleared by <rewind>, so that the next pass returns the same entries. A filter given by the
+             * caller or shared with <cloneFor> is kept, and a warning is printed on <rewind>: the next pass returns only
+             * the keys not seen yet.
+             *
+             * Pass the same filter to several wrappers, or use <cloneFor> which shares it, to remove duplicates across
+             * threads. Which occurrence is kept then depends on the order the threads reach them. Set a memory budget on
+             * the filter to bound its size, at the cost of rare false positives, see <DuplicateFilter>.
+             *
+             * Throw `std::runtime_error` from <next> if a key leaf does not exist, and from this function if the loop was
+             * resumed from a checkpoint, see <resume>.
+             *
+             * @return the filter, for example to read the number of duplicates found
+             */
+            std::shared_ptr<DuplicateFilter> removeDuplicates(const std::vector<std::string>& keys, std::shared_ptr<DuplicateFilter> filter = nullptr);
+
+            /* Number of entries jumped over by <next> thanks to <addClusterPredicate> */
+            uint64_t skippedEntries() const {
+                return m_skipped_entries;
+            }
+
+            /* Set the options used to create a branch in write mode
+             * @name the branch name
+             * @options the options
+             *
+             * Must be called before the branch is registered with <Leaf::write> or <VarrLeaf::write>.
+             */
+            void setBranchOptions(const std::string& name, const BranchOptions& options) {
+                m_branch_options[name] = options;
+            }
+
+            /* Get the options used to create a branch in write mode
+             * @name the branch name
+             *
+             * @return the options set with <setBranchOptions>, or the defaults of the write policy
+             */
+            const BranchOptions& getBranchOptions(const std::string& name) const {
+                auto it = m_branch_options.find(name);
+                if (it != m_branch_options.end())
+                    return it->second;
+
+                return m_write_policy.defaults;
+            }
+
+            /* Set the policy used to tune the branches in write mode
+             * @policy the policy
+             *
+             * Must be called before any branch is registered with <Leaf::write> or <VarrLeaf::write>.
+             * @see WritePolicy
+             */
+            void setWritePolicy(const WritePolicy& policy) {
+                m_write_policy = policy;
+            }
+
+            /* Tune the baskets and the compression of the branches from the entries filled so far
+             *
+             * The baskets are flushed to get the actual compressed sizes. Basket sizes are then optimized with
+             * `TTree::OptimizeBaskets`, and the compression of each branch is chosen according to the target of the
+             * write policy and to its compression factor. Branches with an explicit compression set with
+             * <setBranchOptions> are left untouched.
+             *
+             * Called automatically by <fill> if the write policy has a non-zero <WritePolicy::sampleEntries>.
+             */
+            void optimizeBranches();
+
             /* Fill all the branches.
              * @reset If true, automatically reset all the branches to their default value after filling the tree
              *
@@ -112,6 +439,12 @@ namespace ROOT {
                         leaf.second->reset();
                 }
 
+                for (auto& vGroup: m_varrGroups) {
+                    size += vGroup.second->fillBranches();
+                    if (reset)
+                        vGroup.second->reset();
+                }
+
                 return size;
             }
 
@@ -137,6 +470,8 @@ namespace ROOT {
             inline void reset() {
                 for (auto& leaf: m_leafs)
                     leaf.second->reset();
+                for (auto& vGroup: m_varrGroups)
+                    vGroup.second->reset();
             }
 
             /* Register a new branch into the tree.
@@ -154,6 +489,19 @@ namespace ROOT {
              */
             Leaf& operator[](const std::string& name);
 
+            /* Register a branch for read access, and get a handle on its data
+             * @T Type of data this branch holds
+             * @name the name of the branch
+             *
+             * Equivalent to `tree[name].handle<T>()`. Dereferencing the handle in the event loop is a single pointer load,
+             * without the lookup done by <operator[]>.
+             *
+             * @return a handle on the data hold by the branch. See <Leaf::handle>.
+             */
+            template<typename T> LeafHandle<T> handle(const std::string& name) {
+                return operator[](name).handle<T>();
+            }
+
             /* Create a new group inside the tree.
              * @prefix A string which will be automatically prefixed to all the branches created in this group
              *
@@ -163,11 +511,51 @@ namespace ROOT {
              */
             TreeGroup group(const std::string& prefix);
 
+            /* Define a computed column
+             * @T the type of the column
+             * @name the name of the column
+             * @function computes the value of the column, with one parameter per input. For example
+             * `[](const std::vector<float>& pt) { return std::accumulate(pt.begin(), pt.end(), 0.f); }`
+             * @inputs the names of the branches, or of other computed columns, passed to <function>, in order
+             *
+             * The column is read like any other branch, with `tree[name].read<T>()`. It is computed at most once per
+             * entry, the first time <Leaf::read> is called for it. Inputs which are not registered otherwise are not read
+             * by <next> either, but only when a computed column needs them.
+             *
+             * The reference returned by <Leaf::read> always points to the same storage, but only <Leaf::read> triggers
+             * the computation: call it again for each entry rather than keeping the reference or a <LeafHandle>.
+             *
+             * @return the leaf holding the column
+             */
+            template<typename T, typename F>
+            Leaf& define(const std::string& name, F function, const std::vector<std::string>& inputs) {
+                using traits = ROOT::utils::function_traits<F>;
+                if (inputs.size() != traits::arity)
+                    throw std::runtime_error("Column " + name + " expects " + std::to_string(traits::arity) + " inputs, " + std::to_string(inputs.size()) + " given");
+
+                std::shared_ptr<Leaf>& leaf = m_leafs[name];
+                if (! leaf)
+                    leaf.reset(new Leaf(name, this));
+                else if (! leaf->m_data.empty() || leaf->m_data_ptr)
+                    throw std::runtime_error("Branch " + name + " is already registered");
+
+                // Replayed after its inputs by <cloneFor>, since they must be defined first
+                m_leaf_order.erase(std::remove(m_leaf_order.begin(), m_leaf_order.end(), name), m_leaf_order.end());
+                m_leaf_order.push_back(name);
+
+                T& output = leaf->transient_write<T>(false);
+                leaf->m_compute = makeCompute(output, function, inputs, ROOT::utils::make_index_sequence<traits::arity>());
+                leaf->m_replay = [function, inputs](Leaf& leaf) { leaf.m_tree.wrapper->define<T>(leaf.name(), function, inputs); };
+
+                return *leaf;
+            }
+
             /* Retrieve or register a new group of variable-sized array branches.
              * @S type of the length leaf
              * @name name of the length leaf
              *
-             * Register a new branch named <name>, with type <S>, into the tree. Only read mode is supported for now.
+             * Register a new branch named <name>, with type <S>, into the tree. The length branch is read or written
+             * depending on the access mode of the branches of the group (<VarrLeaf::read> or <VarrLeaf::write>).
              * Branches that use this length leaf can be retrieved from the VarrGroup in the same way as normal branches
              * from the TreeWrapper.
              *
@@ -202,8 +590,15 @@ namespace ROOT {
                   return (*varrLeaf.second)[name];
                 }
               }
+              if ( ! m_friends.empty() ) {
+                std::string localName;
+                TreeWrapper* wrapper = findFriend(name, localName);
+                if ( wrapper ) {
+                  return wrapper->varr<S>(localName);
+                }
+              }
               if ( m_tree ) {
-                TLeaf* leaf = m_tree->GetLeaf(name.c_str());
+                TLeaf* leaf = branchIndex().leaf(name);
                 if ( ! leaf ) {
                   throw std::runtime_error("No leaf with name "+name+" found in tree");
                 }
@@ -221,6 +616,20 @@ namespace ROOT {
               }
             }
 
+            /* Create an array-of-structs view over a group of variable-sized array branches
+             * @T the struct type
+             * @S length-branch type
+             * @lenName name of the length leaf
+             * @fields the bindings between members of <T> and branches, created with <ROOT::field>
+             *
+             * @return a Collection, valid for the whole event loop
+             * @see VarrGroup::collection
+             */
+            template<typename T, typename S = int, typename... F>
+            Collection<T, F...> collection(const std::string& lenName, const CollectionField<T, F>&... fields) {
+              return varrGroup<S>(lenName).template collection<T>(fields...);
+            }
+
             /**
              * Copy the whole tree for entries that pass the selection
              * @selection callable that evalutes to true for passing entries
@@ -255,15 +664,220 @@ namespace ROOT {
               return newTree;
             }
 
+        private:
+            /* Load the tree of the chain holding <entry>
+             * @entry the entry, global to the chain
+             *
+             * Stay on the current tree without calling `TChain::LoadTree` if <entry> belongs to it.
+             *
+             * @return the entry local to the current tree, or a negative value in case of error
+             */
+            int64_t loadTree(uint64_t entry);
+
+            /* Update the cached range of the current tree of the chain, after it changed */
+            void onTreeChanged();
+
+            /* Start opening the file following the current one in the chain */
+            void prefetchNextFile();
+
+            /* Names of all the registered branches */
+            std::vector<std::string> getBranchNames() const;
+
+            /* Compressed size of the registered branches, for each cluster
+             * @starts filled with the first entry of each cluster, global to the chain, plus the total number of entries
+             * @bytes filled with the compressed size of each cluster
+             */
+            void getClusterSizes(std::vector<uint64_t>& starts, std::vector<uint64_t>& bytes);
+
+            // Register the inputs of a computed column, and build the function evaluating it
+            template<typename T, typename F, std::size_t... I>
+            std::function<void()> makeCompute(T& output, F function, const std::vector<std::string>& inputs, ROOT::utils::index_sequence<I...>) {
+                using traits = ROOT::utils::function_traits<F>;
+
+                std::vector<Leaf*> leafs{ &(*this)[inputs[I]]... };
+                std::tuple<const typename traits::template arg<I>*...> values(&leafs[I]->readLazy<typename traits::template arg<I>>()...);
+                T* result = &output;
+
+                return [function, leafs, values, result]() mutable {
+                    for (Leaf* leaf: leafs)
+                        leaf->fetch();
+                    *result = function(*std::get<I>(values)...);
+                };
+            }
+
+            // Fill the tree with the current content of the branches
+            void fillEntry() {
+                for (auto& vGroup: m_varrGroups)
+                    vGroup.second->prepareFill();
+
+                m_tree->Fill();
+                if (m_stats_recorder)
+                    recordStats();
+
+                if (m_write_policy.sampleEntries && ++m_filled == m_write_policy.sampleEntries)
+                    optimizeBranches();
+            }
+
+            // Save the current content of the branches in <m_sorted_fill>, and flush it when full
+            void bufferEntry();
+
+            // Add the values of the current entry to <m_stats_recorder>
+            void recordStats();
+
+            // First entry from <entry> which is not in a cluster excluded by <m_cluster_predicates>
+            uint64_t skipClusters(uint64_t entry, uint64_t stopAt);
+
+            // Load the cluster statistics of the current tree
+            void loadClusterStats();
+
+            // Check the key of <entry> against <m_duplicate_filter>. Return false for a duplicate.
+            bool isNewKey(uint64_t entry);
+
+            // Clear <m_duplicate_filter> if no other wrapper uses it, warn otherwise
+            void rewindDuplicates();
+
+            // Write the checkpoint file, all the entries before <m_entry> being processed
+            void saveCheckpoint();
+
+            // Wait until new entries are available in follow mode. Return false on timeout or <stopFollowing>.
+            bool waitForEntries();
+
+            // Read the current entry of one leaf, through the ClusterCache if enabled
+            bool readLeaf(Leaf& leaf, uint64_t localEntry);
+
+            // Check if <localEntry> belongs to a new cluster, and if so remember its range
+            bool enterCluster(uint64_t localEntry);
+
+            // Read all the leafs and groups with `TTree::GetEntry`, parallelized by ROOT implicit multi-threading
+            bool readParallel(uint64_t localEntry);
+
+            // The branch index of the current tree, built if needed
+            BranchIndex& branchIndex();
+
+            // Add the footprint of this wrapper to <report>, branch names being prefixed by <prefix>
+            void collectMemory(MemoryReport& report, const std::string& prefix);
+
+            // Shrink caches and basket retention until the footprint is below <m_memory_budget>
+            void enforceMemoryBudget();
+
+            // Apply <m_max_virtual_size> to the tree, and to the current tree of the chain
+            void setMaxVirtualSize();
+
+            // Enable implicit multi-threading on the tree, and on the current tree of the chain, if <m_parallel_threads> is set
+            void applyImplicitMT();
+
+            struct Friend {
+                std::string alias;
+                std::shared_ptr<TreeWrapper> wrapper;
+
+                // Index alignment
+                std::string major;
+                std::string minor;
+                TTree* key_tree;
+                TLeaf* major_leaf;
+                TLeaf* minor_leaf;
+            };
+
+            /* Find the friend holding a branch
+             * @name the branch name, possibly prefixed by the friend alias
+             * @localName filled with the name of the branch inside the friend
+             *
+             * @return the friend wrapper, or null if the branch belongs to the wrapped tree
+             */
+            TreeWrapper* findFriend(const std::string& name, std::string& localName);
+
+            /* Find the entry of an index-aligned friend matching the current entry
+             * @localEntry the current entry, local to the current tree
+             *
+             * @return the friend entry, or a negative value if no entry matches
+             */
+            int64_t getFriendEntry(Friend& f, uint64_t localEntry);
+
         private:
             TTree* m_tree;
             TChain* m_chain; // In case of the tree is in reality a TChain, this stores m_tree casted to TChain
             uint64_t m_entry;
+            uint64_t m_local_entry = 0;
+            uint64_t m_serial = 0;
             uint64_t m_stop_at;
             bool m_stop_at_set = false;
             bool m_cleaned = false;
+            bool m_shared_cache = false;
+            // Owner of the blocks this wrapper inserts in the <ClusterCache>, 0 until the first one
+            uint64_t m_cache_owner = 0;
+
+            bool m_follow = false;
+            unsigned int m_follow_poll = 1000;
+            unsigned int m_follow_timeout = 0;
+            std::atomic<bool> m_stop_following{false};
+
+            std::string m_checkpoint_path;
+            std::chrono::seconds m_checkpoint_interval{60};
+            std::function<void(std::ostream&)> m_checkpoint_save;
+            std::chrono::steady_clock::time_point m_checkpoint_last;
+            // First entry of the next cluster
+            uint64_t m_checkpoint_at = 0;
+            // Set by <resume>. The keys seen by <removeDuplicates> are not part of the checkpoint.
+            bool m_resumed = false;
+
+            BranchIndex m_branch_index;
+
+            size_t m_parallel_threads = 0;
+            TTree* m_cluster_tree = nullptr;
+            int64_t m_cluster_first = 0;
+            int64_t m_cluster_last = 0;
+
+            std::unordered_map<std::string, BranchOptions> m_branch_options;
+            WritePolicy m_write_policy;
+            uint64_t m_filled = 0;
+
+            // Entries waiting to be written in key order. Shared with copies, like the leafs.
+            std::shared_ptr<SortedFill> m_sorted_fill;
+
+            // Statistics recorded while writing. Shared with copies, like the leafs.
+            std::shared_ptr<ClusterStatsRecorder> m_stats_recorder;
+            std::vector<Leaf*> m_stats_leafs;
+
+            std::vector<ClusterPredicate> m_cluster_predicates;
+            ClusterStats m_cluster_stats;
+            bool m_cluster_stats_loaded = false;
+            // Position of the branch of each predicate in <m_cluster_stats>
+            std::vector<int> m_predicate_columns;
+            // Entries known to be in a cluster which cannot be skipped: [first, last)
+            uint64_t m_skip_checked_first = 0;
+            uint64_t m_skip_checked_last = 0;
+            uint64_t m_skipped_entries = 0;
+
+            std::shared_ptr<DuplicateFilter> m_duplicate_filter;
+            // Set if the filter was created by <removeDuplicates> and is not shared. Cleared by <cloneFor>.
+            mutable bool m_duplicate_filter_owned = false;
+            std::vector<std::string> m_duplicate_keys;
+            // Key leaves in the current tree, empty until resolved
+            std::vector<TLeaf*> m_duplicate_leafs;
+            std::vector<uint64_t> m_duplicate_values;
+
+            // Range of entries of the current tree of the chain: [m_tree_first, m_tree_last)
+            uint64_t m_tree_first = 0;
+            uint64_t m_tree_last = 0;
+            int m_tree_number = -1;
+
+            size_t m_memory_budget = 0;
+            // Basket retention set by <enforceMemoryBudget>, 0 for the default
+            size_t m_max_virtual_size = 0;
+            uint64_t m_budget_check_at = 0;
+            bool m_budget_warned = false;
+
+            bool m_preopen = false;
+            double m_preopen_fraction = 0.9;
+            uint64_t m_preopen_at = 0;
+            bool m_preopen_started = false;
+            std::shared_ptr<FilePrefetcher> m_prefetcher;
 
             std::unordered_map<std::string, std::shared_ptr<Leaf>> m_leafs;
+            // Names of the leafs, in registration order
+            std::vector<std::string> m_leaf_order;
             std::unordered_map<std::string, std::shared_ptr<VarrGroup>> m_varrGroups;
+
+            std::vector<Friend> m_friends;
     };
 };
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <string>
+
 #include <TTree.h>
 
 namespace ROOT {
     class TreeWrapper;
+    struct BranchOptions;
 
     struct TreeWrapperAccessor {
         ROOT::TreeWrapper* wrapper;
@@ -12,6 +15,15 @@ namespace ROOT {
         TreeWrapperAccessor(ROOT::TreeWrapper* wrap);
         TTree* tree();
         uint64_t entry();
+        // Entry being read, local to the current tree of a TChain
+        uint64_t localEntry();
+        // Incremented each time an entry is read
+        uint64_t serial();
+        const BranchOptions& branchOptions(const std::string& name);
+        TBranch* branch(const std::string& name);
+        void activate(const std::string& name, TBranch* branch);
+        // Throw if entries are buffered for a sorted fill, they would have no value for the new branch
+        void registerWrite(const std::string& name);
     };
 
 };
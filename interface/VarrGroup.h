@@ -1,22 +1,75 @@
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <vector>
 
-#include "TreeWrapperAccessor.h"
+#include "ArrayView.h"
 #include "Brancher.h"
+#include "Collection.h"
+#include "Resetter.h"
+#include "SortedFill.h"
+#include "TreeWrapperAccessor.h"
 
 namespace ROOT {
   class VarrGroup;
 
+  /* Type-erased access to the read buffer of a VarrLeaf */
+  struct VarrStorage {
+    public:
+      virtual ~VarrStorage() {}
+
+      // Resize the buffer, without going above the reserved capacity. The branch address must stay valid.
+      virtual void resize(std::size_t len) = 0;
+      // Copy <len> elements from <data> into the buffer
+      virtual void assign(const void* data, std::size_t len) = 0;
+      virtual void* data() = 0;
+      virtual std::size_t size() const = 0;
+      virtual std::size_t capacity() const = 0;
+      // Address to give to ROOT when writing. Never null, even if the buffer is empty.
+      virtual void* address() = 0;
+  };
+
+  template<typename T>
+  struct VarrStorageT : VarrStorage {
+    public:
+      VarrStorageT(std::vector<T>& data)
+        : m_data(data)
+      {}
+
+      virtual void resize(std::size_t len) override {
+        if ( len > m_data.capacity() ) {
+          len = m_data.capacity();
+        }
+        m_data.resize(len);
+      }
+
+      virtual void assign(const void* data, std::size_t len) override {
+        const T* first = static_cast<const T*>(data);
+        m_data.assign(first, first + len);
+      }
+
+      virtual void* data() override { return m_data.data(); }
+      virtual std::size_t size() const override { return m_data.size(); }
+      virtual std::size_t capacity() const override { return m_data.capacity(); }
+      virtual void* address() override { return m_data.empty() ? &m_empty : m_data.data(); }
+
+    private:
+      std::vector<T>& m_data;
+      T m_empty = T();
+  };
+
   /* This class holds anything related to a variable-sized array branch
    *
    * The only ways to create a VarrLeaf are from VarrGroup <VarrGroup::operator[]> and TreeWrapper <TreeWrapper::var>
    */
   class VarrLeaf {
     private:
-      VarrLeaf(std::string name, std::string lengthName, const TreeWrapperAccessor& tree)
+      VarrLeaf(std::string name, std::string lengthName, const TreeWrapperAccessor& tree, VarrGroup& group)
         : m_name(name)
         , m_lengthLeafName(lengthName)
         , m_tree(tree)
+        , m_group(group)
       {}
     public:
       VarrLeaf(const VarrLeaf&) = delete;
@@ -40,11 +93,87 @@ namespace ROOT {
        * @return a const reference to the data hold by this branch. The content is in read-only mode, and will change each time <TreeWrapper::next> is called.
        */
       template<typename T> const std::vector<T>& read(std::size_t maxsize=100)
+      {
+        m_vector_used = true;
+        return registerRead<T>(maxsize);
+      }
+
+      /* Register this branch for read access, and get a view over its content
+       * @T Type of data this branch holds
+       *
+       * Same as <read>, but the returned view avoids a copy when bulk reading is enabled on the group (see <VarrGroup::setBulkRead>).
+       *
+       * @return a const reference to a view over the data hold by this branch. The view will change each time <TreeWrapper::next> is called.
+       */
+      template<typename T> const ArrayView<T>& view(std::size_t maxsize=100)
+      {
+        registerRead<T>(maxsize);
+        if ( m_view.empty() ) {
+          std::shared_ptr<ArrayView<T>> view{new ArrayView<T>()};
+          m_raw_view = view.get();
+          m_view = boost::any(view);
+          updateView();
+        }
+
+        return *boost::any_cast<std::shared_ptr<ArrayView<T>>>(m_view);
+      }
+
+      /* Register this branch for write access
+       * @T Type of data this branch holds. Only basic types are supported.
+       * @autoReset if true, the vector will be automatically cleared after each <TreeWrapper::fill>.
+       *
+       * Register this branch for write access. A new branch will be created in the tree, holding a variable-sized
+       * array of T whose length is stored in the length leaf of the group. The length leaf is created automatically,
+       * and filled with the size of the vector each time <TreeWrapper::fill> is called. All the vectors of a group must
+       * have the same size when filling the tree.
+       *
+       * Internally, the `TTree::Branch` method is called with a leaf list like `name[length]/F`.
+       *
+       * @return a reference to the vector hold by this branch. It can grow freely, the branch address is updated before each fill.
+       */
+      template<typename T> std::vector<T>& write(bool autoReset = true)
+      {
+        using data_type = std::vector<T>;
+        if ( m_data.empty() ) {
+          m_tree.registerWrite(m_name);
+          prepareWrite();
+          m_replay = [autoReset] ( VarrLeaf& leaf ) { leaf.write<T>(autoReset); };
+
+          m_data = boost::any(data_type{});
+          data_type* data = &boost::any_cast<data_type&>(m_data);
+
+          m_storage.reset(new VarrStorageT<T>(*data));
+          m_element_size = sizeof(T);
+          m_write = true;
+          m_snapshot = [data] () { return std::unique_ptr<SnapshotColumn>(new SnapshotColumnT<data_type>(*data)); };
+
+          if ( autoReset ) {
+            m_resetter.reset(new ResetterT<data_type>(*data));
+          }
+
+          const BranchOptions& options = m_tree.branchOptions(m_name);
+          if ( m_tree.tree() ) {
+            const std::string leaflist = m_name + "[" + m_lengthLeafName + "]/" + ROOT::utils::leaflist_type<T>::value;
+            m_branch = m_tree.tree()->Branch(m_name.c_str(), m_storage->address(), leaflist.c_str(), options.basketSize);
+            ROOT::utils::applyBranchOptions(m_branch, options);
+          } else {
+            m_brancher.reset(new VarrBranchCreaterT<T>(m_storage->address(), &m_branch, m_lengthLeafName, options));
+          }
+        }
+
+        return boost::any_cast<data_type&>(m_data);
+      }
+
+    private:
+      template<typename T> const std::vector<T>& registerRead(std::size_t maxsize)
       {
         using data_type = std::vector<T>;
         if ( m_data.empty() && ( ! m_data_ptr ) ) {
+          prepareRead();
+          m_replay = [maxsize] ( VarrLeaf& leaf ) { leaf.registerRead<T>(maxsize); };
+
           if ( m_tree.tree() ) {
-            m_branch = m_tree.tree()->GetBranch(m_name.c_str());
+            m_branch = m_tree.branch(m_name);
             if ( ! m_branch ) {
               std::cout << "Warning: branch '" << m_name << "' not found in tree" << std::endl;
             }
@@ -54,12 +183,8 @@ namespace ROOT {
           data_type* data = &boost::any_cast<data_type&>(m_data);
           data->reserve(std::size_t(maxsize));
 
-          m_data_resize = [data] ( std::size_t len ) {
-            if ( len > data->capacity() ) {
-              len = data->capacity();
-            }
-            data->resize(len);
-          };
+          m_storage.reset(new VarrStorageT<T>(*data));
+          m_element_size = sizeof(T);
 
           if ( m_tree.tree() ) {
             if ( m_branch ) {
@@ -72,16 +197,17 @@ namespace ROOT {
               }
 
               m_tree.tree()->SetBranchAddress<T>(m_name.c_str(), data->data(), &m_branch);
-            } else {
-              m_brancher.reset(new VarrBranchReaderT<T>(data->data(), &m_branch, m_lengthLeafName));
             }
+          } else {
+            // No tree yet: the branch is attached by <init>
+            m_brancher.reset(new VarrBranchReaderT<T>(data->data(), &m_branch, m_lengthLeafName));
           }
 
           if ( m_branch ) {
             // Enable read for this branch
-            ROOT::utils::activateBranch(m_branch);
+            m_tree.activate(m_name, m_branch);
 
-            if ( m_tree.entry() != -1 ) {
+            if ( m_tree.entry() != uint64_t(-1) ) {
               // A global GetEntry already happened in the tree
               // Call GetEntry directly on the Branch to catch up
               m_branch->GetEntry(m_tree.entry());
@@ -92,30 +218,123 @@ namespace ROOT {
         return const_cast<const data_type&>(boost::any_cast<data_type&>(m_data));
       }
 
-    private:
       void getEntry(uint64_t entry, std::size_t len, bool readall)
       {
-        m_data_resize(len);
+        m_storage->resize(len);
         if ( ! readall ) {
           m_branch->GetEntry(entry);
         }
+        m_view_data = m_storage->data();
+        m_view_size = m_storage->size();
+        updateView();
+      }
+
+      /* Decode entries [first, last) directly into the bulk block
+       * @offsets cumulated lengths, one per entry plus one
+       */
+      void decodeBlock(int64_t first, int64_t last, const std::vector<std::size_t>& offsets)
+      {
+        // Never give a null address to ROOT, it would allocate its own buffer
+        const std::size_t size = std::max<std::size_t>(offsets.back(), 1) * m_element_size;
+        if ( m_block.size() < size ) {
+          m_block.resize(size);
+        }
+
+        char* base = m_block.data();
+        for ( int64_t entry = first; entry != last; ++entry ) {
+          m_branch->SetAddress(base + offsets[entry - first] * m_element_size);
+          m_branch->GetEntry(entry);
+        }
+
+        // Reads outside of the bulk path (readall, direct GetEntry) must land in the read buffer, not in the block
+        m_branch->SetAddress(m_storage->data());
+      }
+
+      void setBlockEntry(std::size_t offset, std::size_t len)
+      {
+        // Same cap as <VarrStorage::resize> in the normal path
+        len = std::min(len, m_storage->capacity());
+
+        m_view_data = m_block.data() + offset * m_element_size;
+        m_view_size = len;
+        if ( m_vector_used ) {
+          m_storage->assign(m_view_data, len);
+          // The buffer must stay the branch address for the reads outside of the bulk path
+          m_branch->SetAddress(m_storage->data());
+        }
+        updateView();
+      }
+
+      // Point the branch back to the read buffer, after bulk reading
+      void restoreAddress()
+      {
+        if ( m_branch && m_storage ) {
+          m_storage->resize(0);
+          m_branch->SetAddress(m_storage->data());
+        }
+      }
+
+      // Register the length leaf of the group. Defined after VarrGroup.
+      void prepareRead();
+      void prepareWrite();
+
+      // Point the branch to the current content of the vector, before filling the tree
+      void prepareFill()
+      {
+        m_branch->SetAddress(m_storage->address());
+      }
+
+      void reset()
+      {
+        if ( m_resetter.get() ) {
+          m_resetter->reset();
+        }
+      }
+
+      void updateView()
+      {
+        if ( m_raw_view ) {
+          m_raw_view->data = m_view_data;
+          m_raw_view->size = m_view_size;
+        }
       }
 
       void init(const TreeWrapperAccessor& tree) {
         m_tree = tree;
         if ( m_brancher.get()) {
-          (*m_brancher)(m_name, m_tree.tree());
+          (*m_brancher)(m_name, m_tree);
         }
       }
 
       TBranch* getBranch() const { return m_branch; }
 
+      // Memory used by the read or write buffer, and by the bulk block
+      std::size_t bufferSize() const
+      {
+        std::size_t size = m_block.capacity();
+        if ( m_storage ) {
+          size += m_storage->capacity() * m_element_size;
+        }
+        return size;
+      }
+
     private:
       friend class TreeWrapper;
       friend class VarrGroup;
 
       boost::any m_data;
-      std::function<void(std::size_t)> m_data_resize;
+      std::unique_ptr<VarrStorage> m_storage;
+      std::size_t m_element_size = 0;
+      bool m_vector_used = false;
+
+      // Content of the current entry
+      const void* m_view_data = nullptr;
+      std::size_t m_view_size = 0;
+      boost::any m_view;
+      RawArrayView* m_raw_view = nullptr;
+
+      // Decoded entries, when bulk reading is enabled on the group
+      std::vector<char> m_block;
 
       void* m_data_ptr = nullptr;
 
@@ -124,8 +343,18 @@ namespace ROOT {
       std::string m_name;
       std::string m_lengthLeafName;
       TreeWrapperAccessor m_tree;
+      VarrGroup& m_group;
+
+      bool m_write = false;
 
       std::unique_ptr<Brancher> m_brancher;
+      std::unique_ptr<Resetter> m_resetter;
+
+      // Register the same type and access mode on another leaf. Used by <TreeWrapper::cloneFor>.
+      std::function<void(VarrLeaf&)> m_replay;
+
+      // Copy the write buffer, for <TreeWrapper::setSortedFill>
+      std::function<std::unique_ptr<SnapshotColumn>()> m_snapshot;
   };
 
   class VarrGroup {
@@ -139,18 +368,71 @@ namespace ROOT {
           return *(m_leafs.at(name));
         }
 
-        std::shared_ptr<VarrLeaf> leaf{new VarrLeaf(name, m_lengthLeaf->name(), &m_wrapper)};
+        std::shared_ptr<VarrLeaf> leaf{new VarrLeaf(name, m_lengthLeaf->name(), m_wrapper, *this)};
         m_leafs[name] = leaf;
+        // The current block does not hold the new leaf
+        m_block_tree = nullptr;
 
         return *leaf;
       }
 
+      /* Create an array-of-structs view over branches of this group
+       * @T the struct type
+       * @fields the bindings between members of <T> and branches, created with <ROOT::field>
+       *
+       * The bound branches are registered for read access, like with <VarrLeaf::view>.
+       *
+       * @return a Collection, valid for the whole event loop
+       * @see Collection
+       */
+      template<typename T, typename... F>
+      Collection<T, F...> collection(const CollectionField<T, F>&... fields)
+      {
+        static_assert(sizeof...(F) > 0, "At least one field must be bound");
+        return Collection<T, F...>(std::make_tuple(fields.member...), std::make_tuple(&(*this)[fields.name].template view<F>()...));
+      }
+
+      /* Enable bulk reading of the group
+       * @enable if true, read the whole group one cluster at a time
+       * @maxEntries maximum number of entries decoded at once
+       *
+       * In bulk mode, the length branch is read once for all the entries of the cluster, then each branch of the group
+       * is decoded for the whole cluster directly into a contiguous block, one branch after the other. Views returned by
+       * <VarrLeaf::view> point into these blocks, without any copy. Entries are still decoded one by one with
+       * `TBranch::GetEntry`: the gain is the better locality of reading one branch at a time and the absence of copies,
+       * not a faster decompression.
+       */
+      void setBulkRead(bool enable, std::size_t maxEntries = 10000)
+      {
+        if ( m_bulk && ! enable ) {
+          for ( auto& ilf : m_leafs ) {
+            ilf.second->restoreAddress();
+          }
+        }
+        m_bulk = enable;
+        m_bulk_max_entries = std::max<std::size_t>(maxEntries, 1);
+        m_block_tree = nullptr;
+      }
+
+      /* Read an entry
+       * @entry the entry to read, local to the current tree
+       * @readall true if the entry has already been read by `TTree::GetEntry`
+       */
       void getEntry(uint64_t entry, bool readall)
       {
+        if ( ! m_length->isRead() || ! m_lengthLeaf->m_branch ) {
+          return;
+        }
+
+        if ( m_bulk && ! readall ) {
+          getBulkEntry(entry);
+          return;
+        }
+
         if ( ! readall ) {
           m_lengthLeaf->m_branch->GetEntry(entry);
         }
-        const std::size_t len = m_lengthReader->get();
+        const std::size_t len = m_length->get();
         for ( const auto& ilf : m_leafs ) {
           ilf.second->getEntry(entry, len, readall);
         }
@@ -162,41 +444,205 @@ namespace ROOT {
           ilf.second->init(tree);
         }
       }
+
+      /* Set the length leaf and the branch addresses before filling the tree
+       *
+       * Throw `std::runtime_error` if the vectors of the group do not all have the same size.
+       */
+      void prepareFill()
+      {
+        if ( ! m_length->isWritten() ) {
+          return;
+        }
+
+        bool first = true;
+        std::size_t len = 0;
+        for ( const auto& ilf : m_leafs ) {
+          VarrLeaf& leaf = *ilf.second;
+          if ( ! leaf.m_write ) {
+            continue;
+          }
+          if ( first ) {
+            len = leaf.m_storage->size();
+            first = false;
+          } else if ( leaf.m_storage->size() != len ) {
+            throw std::runtime_error("Branches of group "+m_lengthLeaf->name()+" do not have the same size");
+          }
+        }
+
+        m_length->set(len);
+        for ( const auto& ilf : m_leafs ) {
+          if ( ilf.second->m_write ) {
+            ilf.second->prepareFill();
+          }
+        }
+      }
+
+      /* Fill the branches of the group, see <TreeWrapper::fillBranches> */
+      size_t fillBranches()
+      {
+        if ( ! m_length->isWritten() ) {
+          return 0;
+        }
+
+        prepareFill();
+        size_t size = m_lengthLeaf->m_branch->Fill();
+        for ( const auto& ilf : m_leafs ) {
+          if ( ilf.second->m_write ) {
+            size += ilf.second->m_branch->Fill();
+          }
+        }
+
+        return size;
+      }
+
+      void reset()
+      {
+        for ( const auto& ilf : m_leafs ) {
+          ilf.second->reset();
+        }
+      }
     private:
-      class LengthReader {
+      friend class VarrLeaf;
+
+      /* Access to the length leaf, whose type is only known when the group is created */
+      class LengthHandler {
       public:
-        virtual ~LengthReader() {}
+        virtual ~LengthHandler() {}
         virtual std::size_t get() const = 0;
-      private:
+        virtual void set(std::size_t len) = 0;
+        // Overwrite the read buffer, for entries not read through the length branch
+        virtual void setRead(std::size_t len) = 0;
+        virtual void registerRead() = 0;
+        virtual void registerWrite() = 0;
+        virtual bool isRead() const = 0;
+        virtual bool isWritten() const = 0;
+        virtual std::shared_ptr<VarrGroup> create(std::shared_ptr<Leaf> lengthLeaf, TreeWrapper& wrapper) const = 0;
       };
 
-      VarrGroup(std::shared_ptr<Leaf> lengthLeaf, TreeWrapper& wrapper, typename std::unique_ptr<LengthReader>&& lengthReader) :
+      void getBulkEntry(uint64_t entry)
+      {
+        const int64_t local = entry;
+        TTree* tree = m_lengthLeaf->m_branch->GetTree();
+        if ( tree != m_block_tree || local < m_block_first || local >= m_block_last ) {
+          TTree::TClusterIterator clusters = tree->GetClusterIterator(local);
+          const int64_t clusterFirst = clusters.Next();
+          const int64_t clusterLast = clusters.GetNextEntry();
+
+          // Split big clusters in chunks of at most m_bulk_max_entries entries
+          const int64_t maxEntries = m_bulk_max_entries;
+          m_block_first = clusterFirst + ( local - clusterFirst ) / maxEntries * maxEntries;
+          m_block_last = std::min(clusterLast, m_block_first + maxEntries);
+          m_block_tree = tree;
+
+          m_offsets.resize(1);
+          for ( int64_t i = m_block_first; i != m_block_last; ++i ) {
+            m_lengthLeaf->m_branch->GetEntry(i);
+            m_offsets.push_back(m_offsets.back() + m_length->get());
+          }
+
+          for ( const auto& ilf : m_leafs ) {
+            ilf.second->decodeBlock(m_block_first, m_block_last, m_offsets);
+          }
+        }
+
+        const std::size_t i = local - m_block_first;
+        const std::size_t offset = m_offsets[i];
+        const std::size_t len = m_offsets[i+1] - offset;
+        // The length buffer holds the last entry of the block after decoding it
+        m_length->setRead(len);
+        for ( const auto& ilf : m_leafs ) {
+          ilf.second->setBlockEntry(offset, len);
+        }
+      }
+
+      VarrGroup(std::shared_ptr<Leaf> lengthLeaf, TreeWrapper& wrapper, typename std::unique_ptr<LengthHandler>&& length) :
         m_lengthLeaf(lengthLeaf),
-        m_wrapper(wrapper),
-        m_lengthReader(std::move(lengthReader))
+        m_wrapper(&wrapper),
+        m_length(std::move(length))
       {}
+
+      /* Create a group with the same length type, the same leaves and the same settings, for another wrapper */
+      std::shared_ptr<VarrGroup> clone(TreeWrapper& wrapper) const
+      {
+        std::shared_ptr<Leaf> lengthLeaf{new Leaf(m_lengthLeaf->name(), &wrapper)};
+        std::shared_ptr<VarrGroup> group = m_length->create(lengthLeaf, wrapper);
+        group->m_bulk = m_bulk;
+        group->m_bulk_max_entries = m_bulk_max_entries;
+
+        for ( const auto& ilf : m_leafs ) {
+          VarrLeaf& leaf = (*group)[ilf.first];
+          if ( ilf.second->m_replay ) {
+            ilf.second->m_replay(leaf);
+          }
+          leaf.m_vector_used = ilf.second->m_vector_used;
+        }
+
+        return group;
+      }
     private:
       std::shared_ptr<Leaf> m_lengthLeaf;
       std::unordered_map<std::string, std::shared_ptr<VarrLeaf>> m_leafs;
-      TreeWrapper& m_wrapper;
+      TreeWrapper* m_wrapper;
+
+      std::unique_ptr<LengthHandler> m_length;
+
+      // Force the next bulk read to decode a new block, after the tree of a chain changed
+      void invalidateBlock() { m_block_tree = nullptr; }
 
-      std::unique_ptr<LengthReader> m_lengthReader;
+      bool m_bulk = false;
+      std::size_t m_bulk_max_entries = 10000;
+      TTree* m_block_tree = nullptr;
+      int64_t m_block_first = 0;
+      int64_t m_block_last = 0;
+      std::vector<std::size_t> m_offsets{0};
     private:
       template<typename S>
-      class LengthReaderT : public LengthReader {
+      class LengthHandlerT : public LengthHandler {
       public:
-        LengthReaderT(Leaf& lenLeaf) : m_data{lenLeaf.read<S>()} {}
-        virtual ~LengthReaderT() {}
+        LengthHandlerT(Leaf& lenLeaf) : m_leaf(lenLeaf) {}
+        virtual ~LengthHandlerT() {}
         //
-        std::size_t get() const override { return m_data; }
+        std::size_t get() const override { return *m_read; }
+        void set(std::size_t len) override { *m_write = len; }
+        void setRead(std::size_t len) override { *m_read = len; }
+        void registerRead() override {
+          if ( ! m_read ) {
+            // Written by <setRead> in bulk mode, the leaf owns the buffer
+            m_read = const_cast<S*>(&m_leaf.read<S>());
+          }
+        }
+        void registerWrite() override {
+          if ( ! m_write ) {
+            // Set before each fill, no need to reset it
+            m_write = &m_leaf.write<S>(false);
+          }
+        }
+        bool isRead() const override { return m_read; }
+        bool isWritten() const override { return m_write; }
+        std::shared_ptr<VarrGroup> create(std::shared_ptr<Leaf> lengthLeaf, TreeWrapper& wrapper) const override {
+          return VarrGroup::create<S>(lengthLeaf, wrapper);
+        }
       private:
-        const S& m_data;
+        Leaf& m_leaf;
+        S* m_read = nullptr;
+        S* m_write = nullptr;
       };
 
       template<typename S>
       static std::shared_ptr<VarrGroup> create(std::shared_ptr<Leaf> lengthLeaf, TreeWrapper& wrapper)
       {
-        return std::shared_ptr<VarrGroup>(new VarrGroup(lengthLeaf, wrapper, std::unique_ptr<LengthReader>(new LengthReaderT<S>(*lengthLeaf))));
+        return std::shared_ptr<VarrGroup>(new VarrGroup(lengthLeaf, wrapper, std::unique_ptr<LengthHandler>(new LengthHandlerT<S>(*lengthLeaf))));
       }
   };
+
+  inline void VarrLeaf::prepareRead()
+  {
+    m_group.m_length->registerRead();
+  }
+
+  inline void VarrLeaf::prepareWrite()
+  {
+    m_group.m_length->registerWrite();
+  }
 }
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Brancher.h"
+
+namespace ROOT {
+
+    /* How to trade read speed for file size when choosing the compression of a branch */
+    enum class CompressionTarget {
+        Speed,      // LZ4, or no compression for branches which do not compress
+        Balanced,   // LZ4 for branches which compress poorly, ZSTD for the others
+        Size        // ZSTD with a high level for every branch
+    };
+
+    /* Writer-side policy used to tune the branches of a tree in write mode
+     *
+     * Branches are created with <defaults>, unless specific options are given with <TreeWrapper::setBranchOptions>.
+     *
+     * If <sampleEntries> is not 0, the baskets are flushed once <sampleEntries> entries are filled, and the observed
+     * entry sizes and compression factors are used to resize the baskets and choose the compression of each branch.
+     * See <TreeWrapper::optimizeBranches>.
+     */
+    struct WritePolicy {
+        BranchOptions defaults;
+
+        uint64_t sampleEntries = 0;
+        CompressionTarget target = CompressionTarget::Balanced;
+
+        // Total memory for the baskets of the tree, used to size them. See `TTree::OptimizeBaskets`.
+        uint64_t basketMemory = 10000000;
+    };
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstring>
+
+#include <TBranch.h>
+#include <TLeaf.h>
+#include <TTree.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/BranchIndex.h"
+#else
+#include <BranchIndex.h>
+#endif
+
+namespace ROOT {
+    void BranchIndex::Stats::print(std::ostream& out/* = std::cout*/) const {
+        out << "Branch index: " << branches << " branches, " << builds << " builds, " << reuses << " reuses, "
+            << seconds * 1000 << " ms" << std::endl;
+    }
+
+    void BranchIndex::build(TTree* tree) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<TBranch*> flat;
+        std::vector<std::size_t> ends;
+        flat.reserve(m_branches.size());
+        ends.reserve(m_ends.size());
+        if (tree)
+            collect(tree->GetListOfBranches(), flat, ends);
+
+        // Same schema as the previous tree: only the branch pointers change
+        bool same = flat.size() == m_names.size() && ends == m_ends;
+        for (std::size_t i = 0; same && i != flat.size(); ++i)
+            same = std::strcmp(flat[i]->GetName(), m_names[i].c_str()) == 0;
+
+        if (same) {
+            m_stats.reuses++;
+        } else {
+            m_names.clear();
+            m_positions.clear();
+            m_names.reserve(flat.size());
+            m_positions.reserve(flat.size());
+            for (std::size_t i = 0; i != flat.size(); ++i) {
+                m_names.emplace_back(flat[i]->GetName());
+                // Keep the first branch in case of duplicated names, like TTree::GetBranch
+                m_positions.emplace(m_names.back(), i);
+            }
+
+            m_ends.swap(ends);
+            m_stats.builds++;
+        }
+
+        m_branches.swap(flat);
+        m_tree = tree;
+
+        m_stats.branches = m_branches.size();
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void BranchIndex::collect(TObjArray* branches, std::vector<TBranch*>& flat, std::vector<std::size_t>& ends) {
+        if (! branches)
+            return;
+
+        const std::size_t nBranches = branches->GetEntriesFast();
+        for (std::size_t i = 0; i != nBranches; ++i) {
+            TBranch* branch = static_cast<TBranch*>(branches->UncheckedAt(i));
+            if (! branch)
+                continue;
+
+            const std::size_t position = flat.size();
+            flat.push_back(branch);
+            ends.push_back(0);
+
+            collect(branch->GetListOfBranches(), flat, ends);
+            ends[position] = flat.size();
+        }
+    }
+
+    TBranch* BranchIndex::branch(const std::string& name) const {
+        auto it = m_positions.find(name);
+        if (it != m_positions.end())
+            return m_branches[it->second];
+
+        return m_tree ? m_tree->GetBranch(name.c_str()) : nullptr;
+    }
+
+    TLeaf* BranchIndex::leaf(const std::string& name) const {
+        auto it = m_positions.find(name);
+        if (it != m_positions.end()) {
+            TLeaf* leaf = m_branches[it->second]->GetLeaf(name.c_str());
+            if (leaf)
+                return leaf;
+        }
+
+        return m_tree ? m_tree->GetLeaf(name.c_str()) : nullptr;
+    }
+
+    bool BranchIndex::activate(const std::string& name) const {
+        auto it = m_positions.find(name);
+        if (it == m_positions.end())
+            return false;
+
+        for (std::size_t i = it->second; i != m_ends[it->second]; ++i)
+            m_branches[i]->SetStatus(1);
+
+        return true;
+    }
+};
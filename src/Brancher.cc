@@ -1,6 +1,12 @@
 
 #include <TTree.h>
 
+#ifdef FROM_CMSSW
+#include "../interface/Brancher.h"
+#else
+#include <Brancher.h>
+#endif
+
 namespace ROOT {
 
     namespace utils {
@@ -18,5 +24,13 @@ namespace ROOT {
                 }
             }
         }
+
+        void applyBranchOptions(TBranch* branch, const BranchOptions& options) {
+            if (! branch)
+                return;
+
+            if (options.compression >= 0)
+                branch->SetCompressionSettings(options.compression);
+        }
     }
 }
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/Checkpoint.h"
+#else
+#include <Checkpoint.h>
+#endif
+
+namespace {
+    const int kVersion = 1;
+}
+
+namespace ROOT {
+    void Checkpoint::write(const std::string& path) const {
+        std::ostringstream out;
+        out << "version " << kVersion << "\n";
+        out << "entry " << entry << "\n";
+        out << "entries " << entries << "\n";
+        out << "stop_at " << stopAt << "\n";
+        out << "stop_at_set " << stopAtSet << "\n";
+        out << "tree_number " << treeNumber << "\n";
+        out << "file " << fileName << "\n";
+        out << "user " << user.size() << "\n";
+        out << user;
+
+        const std::string content = out.str();
+        const std::string tmp = path + ".tmp";
+
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (! f)
+            throw std::runtime_error("Unable to open " + tmp + " for writing");
+
+        bool success = std::fwrite(content.data(), 1, content.size(), f) == content.size();
+        success &= std::fflush(f) == 0;
+        success &= ::fsync(fileno(f)) == 0;
+        success &= std::fclose(f) == 0;
+        if (! success || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Error while writing checkpoint " + path);
+        }
+    }
+
+    bool Checkpoint::read(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (! in)
+            return false;
+
+        auto expect = [&in, &path](const std::string& key) {
+            std::string k;
+            in >> k;
+            if (! in || k != key)
+                throw std::runtime_error(path + " is not a valid checkpoint: expected '" + key + "'");
+        };
+
+        int version;
+        expect("version");
+        in >> version;
+        if (version != kVersion)
+            throw std::runtime_error(path + " has an unsupported checkpoint version");
+
+        size_t user_size;
+        expect("entry");
+        in >> entry;
+        expect("entries");
+        in >> entries;
+        expect("stop_at");
+        in >> stopAt;
+        expect("stop_at_set");
+        in >> stopAtSet;
+        expect("tree_number");
+        in >> treeNumber;
+        expect("file");
+        in.ignore(1);
+        std::getline(in, fileName);
+        expect("user");
+        in >> user_size;
+        in.ignore(1);
+
+        user.resize(user_size);
+        if (user_size)
+            in.read(&user[0], user_size);
+
+        if (! in)
+            throw std::runtime_error(path + " is not a valid checkpoint: truncated");
+
+        return true;
+    }
+};
@@ -0,0 +1,170 @@
+#include <iterator>
+
+#ifdef FROM_CMSSW
+#include "../interface/ClusterCache.h"
+#else
+#include <ClusterCache.h>
+#endif
+
+namespace ROOT {
+    ClusterCache::ClusterCache():
+        m_max_size(256 * 1024 * 1024),
+        m_hits(0),
+        m_misses(0),
+        m_next_owner(1) {
+
+        }
+
+    ClusterCache& ClusterCache::instance() {
+        static ClusterCache s_instance;
+        return s_instance;
+    }
+
+    std::string ClusterCache::key(const std::string& file, const std::string& tree, const std::string& branch, int64_t first) {
+        std::string result;
+        result.reserve(file.size() + tree.size() + branch.size() + 24);
+        result += file;
+        result += '\0';
+        result += tree;
+        result += '\0';
+        result += branch;
+        result += '\0';
+        result += std::to_string(first);
+
+        return result;
+    }
+
+    std::shared_ptr<const ClusterBlock> ClusterCache::get(const std::string& key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            m_misses++;
+            return nullptr;
+        }
+
+        // Move to the front of the LRU list
+        m_items.splice(m_items.begin(), m_items, it->second);
+        m_hits++;
+
+        return it->second->block;
+    }
+
+    std::shared_ptr<const ClusterBlock> ClusterCache::put(const std::string& key, std::shared_ptr<const ClusterBlock> block, uint64_t owner/* = 0*/) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_items.splice(m_items.begin(), m_items, it->second);
+            return it->second->block;
+        }
+
+        auto usage = m_owners.find(owner);
+        if (usage == m_owners.end())
+            owner = 0;
+
+        m_items.push_front(Item{key, block, owner});
+        m_index[key] = m_items.begin();
+        m_size += block->data.size();
+        if (owner)
+            usage->second.size += block->data.size();
+
+        evictOwner(owner);
+        evict();
+
+        return block;
+    }
+
+    uint64_t ClusterCache::newOwner() {
+        const uint64_t owner = m_next_owner++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_owners[owner];
+
+        return owner;
+    }
+
+    void ClusterCache::releaseOwner(uint64_t owner) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_owners.erase(owner)) {
+            for (Item& item: m_items) {
+                if (item.owner == owner)
+                    item.owner = 0;
+            }
+        }
+    }
+
+    void ClusterCache::setOwnerMaxSize(uint64_t owner, size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto usage = m_owners.find(owner);
+        if (usage == m_owners.end())
+            return;
+
+        usage->second.max_size = bytes;
+        evictOwner(owner);
+    }
+
+    size_t ClusterCache::ownerSize(uint64_t owner) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto usage = m_owners.find(owner);
+        return (usage == m_owners.end()) ? 0 : usage->second.size;
+    }
+
+    void ClusterCache::setMaxSize(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_max_size = bytes;
+        evict();
+    }
+
+    size_t ClusterCache::size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size;
+    }
+
+    void ClusterCache::clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_items.clear();
+        m_index.clear();
+        m_size = 0;
+        for (auto& owner: m_owners)
+            owner.second.size = 0;
+    }
+
+    void ClusterCache::evict() {
+        // Always keep the most recent block, even if it's bigger than the cache
+        while (m_size > m_max_size && m_items.size() > 1)
+            remove(std::prev(m_items.end()));
+    }
+
+    void ClusterCache::evictOwner(uint64_t owner) {
+        auto usage = m_owners.find(owner);
+        if (! owner || usage == m_owners.end() || ! usage->second.max_size || m_items.empty())
+            return;
+
+        // Always keep the most recent block, like <evict>
+        auto item = std::prev(m_items.end());
+        while (usage->second.size > usage->second.max_size && item != m_items.begin()) {
+            auto previous = std::prev(item);
+            if (item->owner == owner)
+                remove(item);
+            item = previous;
+        }
+    }
+
+    void ClusterCache::remove(std::list<Item>::iterator item) {
+        m_size -= item->block->data.size();
+        if (item->owner) {
+            auto usage = m_owners.find(item->owner);
+            if (usage != m_owners.end())
+                usage->second.size -= item->block->data.size();
+        }
+
+        m_index.erase(item->key);
+        m_items.erase(item);
+    }
+};
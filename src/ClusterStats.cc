@@ -0,0 +1,230 @@
+#include <cctype>
+#include <stdexcept>
+
+#include <TList.h>
+#include <TObjString.h>
+#include <TTree.h>
+#include <TVectorD.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/ClusterStats.h"
+#else
+#include <ClusterStats.h>
+#endif
+
+namespace ROOT {
+    const char* const ClusterStats::kName = "TreeWrapperClusterStats";
+
+    ClusterPredicate ClusterPredicate::parse(const std::string& expression) {
+        auto invalid = [&expression]() {
+            return std::runtime_error("Invalid cluster predicate: '" + expression + "'");
+        };
+
+        const std::size_t position = expression.find_first_of("<>=!");
+        if (position == std::string::npos)
+            throw invalid();
+
+        ClusterPredicate predicate;
+
+        std::size_t first = expression.find_first_not_of(" \t");
+        std::size_t last = expression.find_last_not_of(" \t", position ? position - 1 : 0);
+        if (first >= position || last == std::string::npos || last < first)
+            throw invalid();
+        predicate.branch = expression.substr(first, last - first + 1);
+
+        const bool equal = position + 1 < expression.size() && expression[position + 1] == '=';
+        switch (expression[position]) {
+            case '<':
+                predicate.op = equal ? Op::LessEqual : Op::Less;
+                break;
+            case '>':
+                predicate.op = equal ? Op::GreaterEqual : Op::Greater;
+                break;
+            case '=':
+                if (! equal)
+                    throw invalid();
+                predicate.op = Op::Equal;
+                break;
+            case '!':
+                if (! equal)
+                    throw invalid();
+                predicate.op = Op::NotEqual;
+                break;
+        }
+
+        const std::string value = expression.substr(position + (equal ? 2 : 1));
+        std::size_t parsed = 0;
+        try {
+            predicate.value = std::stod(value, &parsed);
+        } catch (const std::exception&) {
+            throw invalid();
+        }
+        for (; parsed < value.size(); ++parsed) {
+            if (! std::isspace(static_cast<unsigned char>(value[parsed])))
+                throw invalid();
+        }
+
+        return predicate;
+    }
+
+    bool ClusterPredicate::excludes(const ValueRange& range) const {
+        // A range holding only NaN has min = +inf and max = -inf, and is excluded by everything but !=
+        switch (op) {
+            case Op::Less:
+                return range.min >= value;
+            case Op::LessEqual:
+                return range.min > value;
+            case Op::Greater:
+                return range.max <= value;
+            case Op::GreaterEqual:
+                return range.max < value;
+            case Op::Equal:
+                return value < range.min || value > range.max;
+            case Op::NotEqual:
+                return range.nulls == 0 && range.min == value && range.max == value;
+        }
+
+        return false;
+    }
+
+    /* Layout of the stored object: a TList holding a TVectorD with the cluster boundaries, followed, for each branch,
+     * by its name as a TObjString and by a TVectorD with the minimum, maximum and NaN count of each cluster.
+     */
+    bool ClusterStats::load(TTree* tree) {
+        clear();
+        if (! tree || ! tree->GetUserInfo())
+            return false;
+
+        TList* list = dynamic_cast<TList*>(tree->GetUserInfo()->FindObject(kName));
+        if (! list || list->GetSize() < 1 || list->GetSize() % 2 != 1)
+            return false;
+
+        TVectorD* starts = dynamic_cast<TVectorD*>(list->At(0));
+        if (! starts || starts->GetNrows() < 1)
+            return false;
+
+        const std::size_t nClusters = starts->GetNrows() - 1;
+        m_starts.resize(nClusters + 1);
+        for (std::size_t i = 0; i != m_starts.size(); ++i)
+            m_starts[i] = static_cast<uint64_t>((*starts)[i]);
+
+        for (int i = 1; i < list->GetSize(); i += 2) {
+            TObjString* name = dynamic_cast<TObjString*>(list->At(i));
+            TVectorD* values = dynamic_cast<TVectorD*>(list->At(i + 1));
+            if (! name || ! values || static_cast<std::size_t>(values->GetNrows()) != 3 * nClusters) {
+                clear();
+                return false;
+            }
+
+            m_names.emplace_back(name->GetString().Data());
+            m_ranges.emplace_back(nClusters);
+            for (std::size_t cluster = 0; cluster != nClusters; ++cluster) {
+                ValueRange& range = m_ranges.back()[cluster];
+                range.min = (*values)[3 * cluster];
+                range.max = (*values)[3 * cluster + 1];
+                range.nulls = static_cast<uint64_t>((*values)[3 * cluster + 2]);
+            }
+        }
+
+        return true;
+    }
+
+    void ClusterStats::save(TTree* tree) const {
+        TList* info = tree->GetUserInfo();
+
+        TObject* previous = info->FindObject(kName);
+        if (previous) {
+            info->Remove(previous);
+            delete previous;
+        }
+
+        TList* list = new TList();
+        list->SetName(kName);
+        list->SetOwner();
+
+        TVectorD* starts = new TVectorD(m_starts.size());
+        for (std::size_t i = 0; i != m_starts.size(); ++i)
+            (*starts)[i] = m_starts[i];
+        list->Add(starts);
+
+        for (std::size_t column = 0; column != m_names.size(); ++column) {
+            list->Add(new TObjString(m_names[column].c_str()));
+
+            TVectorD* values = new TVectorD(3 * clusters());
+            for (std::size_t cluster = 0; cluster != clusters(); ++cluster) {
+                const ValueRange& range = m_ranges[column][cluster];
+                (*values)[3 * cluster] = range.min;
+                (*values)[3 * cluster + 1] = range.max;
+                (*values)[3 * cluster + 2] = range.nulls;
+            }
+            list->Add(values);
+        }
+
+        info->Add(list);
+    }
+
+    void ClusterStats::clear() {
+        m_names.clear();
+        m_starts.clear();
+        m_ranges.clear();
+    }
+
+    std::size_t ClusterStats::find(uint64_t entry) const {
+        if (m_starts.empty() || entry < m_starts.front() || entry >= m_starts.back())
+            return clusters();
+
+        return std::upper_bound(m_starts.begin(), m_starts.end(), entry) - m_starts.begin() - 1;
+    }
+
+    int ClusterStats::column(const std::string& name) const {
+        auto it = std::find(m_names.begin(), m_names.end(), name);
+        return (it == m_names.end()) ? -1 : it - m_names.begin();
+    }
+
+    ClusterStatsRecorder::ClusterStatsRecorder(const std::vector<std::string>& names, std::size_t granularity/* = 1000*/):
+        m_names(names),
+        m_granularity(std::max<std::size_t>(granularity, 1)),
+        m_blocks(names.size()) {
+
+        }
+
+    void ClusterStatsRecorder::endEntry() {
+        if (++m_entries % m_granularity)
+            return;
+
+        m_block += m_names.size();
+        m_blocks.resize(m_block + m_names.size());
+    }
+
+    bool ClusterStatsRecorder::build(TTree* tree, ClusterStats& stats) const {
+        stats.clear();
+        if (static_cast<uint64_t>(tree->GetEntries()) != m_entries)
+            return false;
+
+        stats.m_names = m_names;
+        stats.m_ranges.resize(m_names.size());
+
+        TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+        uint64_t start;
+        uint64_t last = 0;
+        while ((start = clusters()) < m_entries) {
+            const uint64_t end = std::min<uint64_t>(clusters.GetNextEntry(), m_entries);
+            if (end <= start)
+                break;
+
+            stats.m_starts.push_back(start);
+            last = end;
+            for (std::size_t column = 0; column != m_names.size(); ++column) {
+                ValueRange range;
+                for (uint64_t block = start / m_granularity; block <= (end - 1) / m_granularity; ++block)
+                    range.merge(m_blocks[block * m_names.size() + column]);
+                stats.m_ranges[column].push_back(range);
+            }
+        }
+
+        if (! stats.m_starts.empty())
+            stats.m_starts.push_back(last);
+
+        return true;
+    }
+};
@@ -0,0 +1,319 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/ColumnarCache.h"
+#else
+#include <ColumnarCache.h>
+#endif
+
+/*
+ * Layout of a cache file (native endianness):
+ *
+ *   char[4]  magic "TWCC"
+ *   uint32   version
+ *   uint64   number of entries
+ *   uint64   number of columns
+ *   for each column:
+ *     uint32 name length, name
+ *     uint32 type length, type (typeid name of the element type)
+ *     uint32 kind (0: fixed-size, 1: variable-sized array)
+ *     uint32 element size
+ *     uint64 data offset, uint64 data size
+ *     uint64 offsets offset (arrays only: entries + 1 uint64, first one is 0)
+ *
+ * Every block is aligned on kAlignment bytes.
+ */
+
+namespace {
+    const char kMagic[4] = {'T', 'W', 'C', 'C'};
+    const uint32_t kVersion = 1;
+    const uint64_t kAlignment = 64;
+
+    uint64_t align(uint64_t offset) {
+        return (offset + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    std::FILE* createSpill() {
+        std::FILE* f = std::tmpfile();
+        if (! f)
+            throw std::runtime_error("Unable to create a temporary file for the columnar cache");
+
+        return f;
+    }
+
+    void writeString(std::FILE* f, const std::string& s) {
+        uint32_t size = s.size();
+        std::fwrite(&size, sizeof(size), 1, f);
+        std::fwrite(s.data(), 1, size, f);
+    }
+
+    template<typename T> void writeValue(std::FILE* f, T value) {
+        std::fwrite(&value, sizeof(T), 1, f);
+    }
+
+    void pad(std::FILE* f, uint64_t offset) {
+        static const char zeros[kAlignment] = {0};
+        std::fwrite(zeros, 1, align(offset) - offset, f);
+    }
+
+    // Copy the whole content of a spill file into the output
+    void copy(std::FILE* from, std::FILE* to) {
+        std::rewind(from);
+
+        char buffer[1 << 16];
+        size_t size;
+        while ((size = std::fread(buffer, 1, sizeof(buffer), from)) > 0)
+            std::fwrite(buffer, 1, size, to);
+    }
+
+    struct Reader {
+        const char* data;
+        size_t size;
+        size_t offset;
+
+        template<typename T> T value() {
+            if (offset + sizeof(T) > size)
+                throw std::runtime_error("Truncated columnar cache file");
+
+            T result;
+            std::memcpy(&result, data + offset, sizeof(T));
+            offset += sizeof(T);
+
+            return result;
+        }
+
+        std::string string() {
+            uint32_t length = value<uint32_t>();
+            if (offset + length > size)
+                throw std::runtime_error("Truncated columnar cache file");
+
+            std::string result(data + offset, length);
+            offset += length;
+
+            return result;
+        }
+    };
+}
+
+namespace ROOT {
+
+    namespace columnar {
+        ColumnSink::ColumnSink(const std::string& name, ColumnKind kind, size_t elementSize, const std::string& type):
+            name(name),
+            type(type),
+            kind(kind),
+            elementSize(elementSize) {
+                data = createSpill();
+                if (kind == Array) {
+                    offsets = createSpill();
+                    uint64_t first = 0;
+                    std::fwrite(&first, sizeof(first), 1, offsets);
+                }
+            }
+
+        ColumnSink::~ColumnSink() {
+            if (data)
+                std::fclose(data);
+            if (offsets)
+                std::fclose(offsets);
+        }
+    }
+
+    ColumnarCacheWriter::ColumnarCacheWriter(TreeWrapper& tree):
+        m_tree(tree) {
+
+        }
+
+    uint64_t ColumnarCacheWriter::write(const std::string& path) {
+        uint64_t entries = 0;
+        while (m_tree.next()) {
+            for (auto& sink: m_sinks)
+                sink->append();
+            entries++;
+        }
+
+        // Compute the header size first, so that data offsets are known when writing it
+        uint64_t header = sizeof(kMagic) + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+        for (auto& sink: m_sinks)
+            header += 4 * sizeof(uint32_t) + sink->name.size() + sink->type.size() + 3 * sizeof(uint64_t);
+
+        std::vector<uint64_t> data_offsets;
+        std::vector<uint64_t> offsets_offsets;
+        uint64_t offset = align(header);
+        for (auto& sink: m_sinks) {
+            data_offsets.push_back(offset);
+            offset = align(offset + sink->elements * sink->elementSize);
+
+            if (sink->kind == columnar::Array) {
+                offsets_offsets.push_back(offset);
+                offset = align(offset + (entries + 1) * sizeof(uint64_t));
+            } else {
+                offsets_offsets.push_back(0);
+            }
+        }
+
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (! f)
+            throw std::runtime_error("Unable to open " + path + " for writing");
+
+        std::fwrite(kMagic, 1, sizeof(kMagic), f);
+        writeValue<uint32_t>(f, kVersion);
+        writeValue<uint64_t>(f, entries);
+        writeValue<uint64_t>(f, m_sinks.size());
+        for (size_t i = 0; i < m_sinks.size(); i++) {
+            const auto& sink = m_sinks[i];
+            writeString(f, sink->name);
+            writeString(f, sink->type);
+            writeValue<uint32_t>(f, sink->kind);
+            writeValue<uint32_t>(f, sink->elementSize);
+            writeValue<uint64_t>(f, data_offsets[i]);
+            writeValue<uint64_t>(f, sink->elements * sink->elementSize);
+            writeValue<uint64_t>(f, offsets_offsets[i]);
+        }
+        pad(f, header);
+
+        for (auto& sink: m_sinks) {
+            uint64_t size = sink->elements * sink->elementSize;
+            std::fflush(sink->data);
+            copy(sink->data, f);
+            pad(f, size);
+
+            if (sink->kind == columnar::Array) {
+                std::fflush(sink->offsets);
+                copy(sink->offsets, f);
+                pad(f, (entries + 1) * sizeof(uint64_t));
+            }
+        }
+
+        bool success = ! std::ferror(f);
+        success &= std::fclose(f) == 0;
+        if (! success)
+            throw std::runtime_error("Error while writing " + path);
+
+        return entries;
+    }
+
+    ColumnarCache::ColumnarCache(const std::string& path):
+        m_path(path) {
+
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Unable to open " + path);
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Unable to stat " + path);
+            }
+
+            m_size = st.st_size;
+            void* map = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (map == MAP_FAILED)
+                throw std::runtime_error("Unable to map " + path);
+
+            m_map = static_cast<char*>(map);
+            ::madvise(m_map, m_size, MADV_SEQUENTIAL);
+
+            try {
+                Reader reader = {m_map, m_size, 0};
+                if (m_size < sizeof(kMagic) || std::memcmp(m_map, kMagic, sizeof(kMagic)) != 0)
+                    throw std::runtime_error(path + " is not a columnar cache file");
+                reader.offset = sizeof(kMagic);
+
+                if (reader.value<uint32_t>() != kVersion)
+                    throw std::runtime_error(path + " has an unsupported version");
+
+                m_entries = reader.value<uint64_t>();
+                uint64_t columns = reader.value<uint64_t>();
+                for (uint64_t i = 0; i < columns; i++) {
+                    std::string name = reader.string();
+                    std::string type = reader.string();
+                    columnar::ColumnKind kind = static_cast<columnar::ColumnKind>(reader.value<uint32_t>());
+                    uint32_t element_size = reader.value<uint32_t>();
+                    uint64_t data_offset = reader.value<uint64_t>();
+                    uint64_t data_size = reader.value<uint64_t>();
+                    uint64_t offsets_offset = reader.value<uint64_t>();
+
+                    if (data_size > m_size || data_offset > m_size - data_size)
+                        throw std::runtime_error("Truncated columnar cache file");
+                    if (! element_size || data_size % element_size)
+                        throw std::runtime_error("Invalid size for column " + name + " in " + path);
+
+                    const uint64_t* offsets = nullptr;
+                    if (kind == columnar::Scalar) {
+                        if (data_size / element_size != m_entries)
+                            throw std::runtime_error("Column " + name + " of " + path + " does not hold one value per entry");
+                    } else if (kind == columnar::Array) {
+                        if (m_entries >= m_size / sizeof(uint64_t) || offsets_offset % sizeof(uint64_t) ||
+                                offsets_offset > m_size - (m_entries + 1) * sizeof(uint64_t))
+                            throw std::runtime_error("Truncated columnar cache file");
+                        offsets = reinterpret_cast<const uint64_t*>(m_map + offsets_offset);
+
+                        // Every entry must lie within the data block
+                        if (offsets[0] != 0 || offsets[m_entries] != data_size / element_size)
+                            throw std::runtime_error("Invalid offsets for column " + name + " in " + path);
+                        for (uint64_t entry = 0; entry < m_entries; entry++) {
+                            if (offsets[entry + 1] < offsets[entry])
+                                throw std::runtime_error("Invalid offsets for column " + name + " in " + path);
+                        }
+                    } else {
+                        throw std::runtime_error("Unknown kind for column " + name + " in " + path);
+                    }
+
+                    m_columns[name].reset(new CachedColumn(*this, name, type, kind, element_size, m_map + data_offset, offsets));
+                }
+            } catch (...) {
+                ::munmap(m_map, m_size);
+                throw;
+            }
+        }
+
+    ColumnarCache::~ColumnarCache() {
+        if (m_map)
+            ::munmap(m_map, m_size);
+    }
+
+    bool ColumnarCache::next() {
+        if (m_entry >= m_entries)
+            return false;
+
+        bool result = getEntry(m_entry);
+        m_entry++;
+
+        return result;
+    }
+
+    bool ColumnarCache::getEntry(uint64_t entry) {
+        if (entry >= m_entries)
+            return false;
+
+        for (auto& column: m_columns) {
+            if (column.second->m_slot)
+                column.second->m_slot->load(entry);
+        }
+
+        m_entry = entry;
+        m_loaded = true;
+        m_loaded_entry = entry;
+        return true;
+    }
+
+    void CachedColumn::bind(columnar::Slot* slot) {
+        m_slot = slot;
+        if (m_cache.m_loaded)
+            m_slot->load(m_cache.m_loaded_entry);
+    }
+
+    CachedColumn& ColumnarCache::operator[](const std::string& name) {
+        auto it = m_columns.find(name);
+        if (it == m_columns.end())
+            throw std::runtime_error("No column named " + name + " in " + m_path);
+
+        return *it->second;
+    }
+};
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#ifdef FROM_CMSSW
+#include "../interface/DuplicateFilter.h"
+#else
+#include <DuplicateFilter.h>
+#endif
+
+namespace {
+    // Finalizer of splitmix64
+    uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    const std::size_t kInitialCapacity = 1024;
+    const std::size_t kBucketSize = 4;
+    const std::size_t kMaxKicks = 500;
+}
+
+namespace ROOT {
+
+    /* The bits of a hash are used as follows: the lowest 32 bits give the slot in the exact table and the bucket in the
+     * cuckoo filter, bits 32 to 47 the shard, and the highest 16 bits the fingerprint.
+     */
+    struct DuplicateFilter::Shard {
+        std::mutex mutex;
+
+        // Exact mode: open addressing with linear probing on the hashes, 0 marks an empty slot
+        std::vector<uint64_t> keys;
+        // Position in <values> of the key of each slot
+        std::vector<std::size_t> positions;
+        // The full keys, one after the other, each preceded by its number of values
+        std::vector<uint64_t> values;
+        std::size_t count = 0;
+
+        // Approximate mode: <kBucketSize> fingerprints per bucket, 0 marks an empty slot
+        bool approximate = false;
+        std::vector<uint16_t> fingerprints;
+        std::size_t mask = 0;
+        // Fingerprint evicted by the last failed insertion. The filter is full once it is set.
+        uint16_t victim = 0;
+        std::size_t victim_bucket = 0;
+        uint64_t random = 0x2545f4914f6cdd1dULL;
+
+        static uint16_t fingerprint(uint64_t hash) {
+            const uint16_t fp = hash >> 48;
+            return fp ? fp : 1;
+        }
+
+        std::size_t alternate(std::size_t bucket, uint16_t fp) const {
+            return (bucket ^ (fp * 0x5bd1e995ULL)) & mask;
+        }
+
+        void reset() {
+            keys.assign(kInitialCapacity, 0);
+            positions.assign(kInitialCapacity, 0);
+            std::vector<uint64_t>().swap(values);
+            count = 0;
+
+            approximate = false;
+            std::vector<uint16_t>().swap(fingerprints);
+            mask = 0;
+            victim = 0;
+            victim_bucket = 0;
+        }
+
+        // Memory used by the exact table once <extra> more values are stored, with <slots> slots
+        std::size_t exactMemory(std::size_t slots, std::size_t extra) const {
+            return slots * (sizeof(uint64_t) + sizeof(std::size_t)) + (values.size() + extra) * sizeof(uint64_t);
+        }
+
+        // Store a key already known to be new
+        void exactPlace(uint64_t hash, std::size_t position) {
+            const std::size_t slots = keys.size() - 1;
+            std::size_t i = hash & slots;
+            while (keys[i])
+                i = (i + 1) & slots;
+
+            keys[i] = hash;
+            positions[i] = position;
+            count++;
+        }
+
+        // Return false if the key is already present. Keys with the same hash are told apart by their values.
+        bool exactInsert(uint64_t hash, const uint64_t* key, std::size_t size) {
+            const std::size_t slots = keys.size() - 1;
+            for (std::size_t i = hash & slots; ; i = (i + 1) & slots) {
+                if (! keys[i]) {
+                    keys[i] = hash;
+                    positions[i] = values.size();
+                    values.push_back(size);
+                    values.insert(values.end(), key, key + size);
+                    count++;
+                    return true;
+                }
+
+                if (keys[i] == hash && values[positions[i]] == size &&
+                        std::equal(key, key + size, values.begin() + positions[i] + 1))
+                    return false;
+            }
+        }
+
+        void grow() {
+            std::vector<uint64_t> previous(keys.size() * 2, 0);
+            std::vector<std::size_t> previous_positions(positions.size() * 2, 0);
+            previous.swap(keys);
+            previous_positions.swap(positions);
+            count = 0;
+            for (std::size_t i = 0; i != previous.size(); ++i) {
+                if (previous[i])
+                    exactPlace(previous[i], previous_positions[i]);
+            }
+        }
+
+        bool place(std::size_t bucket, uint16_t fp) {
+            uint16_t* slots = &fingerprints[bucket * kBucketSize];
+            for (std::size_t i = 0; i != kBucketSize; ++i) {
+                if (! slots[i]) {
+                    slots[i] = fp;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool contains(std::size_t bucket, uint16_t fp) const {
+            const uint16_t* slots = &fingerprints[bucket * kBucketSize];
+            for (std::size_t i = 0; i != kBucketSize; ++i) {
+                if (slots[i] == fp)
+                    return true;
+            }
+            return false;
+        }
+
+        // Return false if the key is already present. Set <victim> if the filter is full.
+        bool approximateInsert(uint64_t hash) {
+            uint16_t fp = fingerprint(hash);
+            std::size_t bucket = hash & mask;
+            const std::size_t other = alternate(bucket, fp);
+
+            if (contains(bucket, fp) || contains(other, fp) || (victim == fp && (victim_bucket == bucket || victim_bucket == other)))
+                return false;
+
+            if (victim)
+                // Full: the key cannot be remembered
+                return true;
+
+            if (place(bucket, fp) || place(other, fp)) {
+                count++;
+                return true;
+            }
+
+            // Move fingerprints to their alternate bucket until a free slot is found
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            bucket = (random & 1) ? bucket : other;
+            for (std::size_t kick = 0; kick != kMaxKicks; ++kick) {
+                random ^= random << 13;
+                random ^= random >> 7;
+                random ^= random << 17;
+                std::swap(fp, fingerprints[bucket * kBucketSize + random % kBucketSize]);
+                bucket = alternate(bucket, fp);
+                if (place(bucket, fp)) {
+                    count++;
+                    return true;
+                }
+            }
+
+            victim = fp;
+            victim_bucket = bucket;
+            count++;
+            return true;
+        }
+
+        std::size_t memory() const {
+            return keys.capacity() * sizeof(uint64_t) + positions.capacity() * sizeof(std::size_t) +
+                values.capacity() * sizeof(uint64_t) + fingerprints.capacity() * sizeof(uint16_t);
+        }
+    };
+
+    DuplicateFilter::DuplicateFilter(std::size_t memoryBudget/* = 0*/, std::size_t shards/* = 64*/):
+        m_inserted(0),
+        m_duplicates(0),
+        m_full_warned(false) {
+
+            shards = std::max<std::size_t>(shards, 1);
+            m_shard_budget = memoryBudget / shards;
+
+            for (std::size_t i = 0; i != shards; ++i) {
+                m_shards.emplace_back(new Shard());
+                m_shards.back()->reset();
+            }
+        }
+
+    DuplicateFilter::~DuplicateFilter() = default;
+
+    uint64_t DuplicateFilter::hash(const uint64_t* values, std::size_t count) {
+        uint64_t result = mix(count);
+        for (std::size_t i = 0; i != count; ++i)
+            result = mix(result ^ values[i]);
+
+        return result ? result : 1;
+    }
+
+    bool DuplicateFilter::insert(const uint64_t* values, std::size_t count) {
+        const uint64_t hash = DuplicateFilter::hash(values, count);
+        Shard& shard = *m_shards[(hash >> 32 & 0xffff) % m_shards.size()];
+
+        bool inserted;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (! shard.approximate) {
+                // Keep the load factor under 3/4
+                const bool grow = 4 * (shard.count + 1) > 3 * shard.keys.size();
+                const std::size_t slots = grow ? 2 * shard.keys.size() : shard.keys.size();
+                if (m_shard_budget && shard.exactMemory(slots, count + 1) > m_shard_budget)
+                    convert(shard);
+                else if (grow)
+                    shard.grow();
+            }
+
+            if (shard.approximate) {
+                const bool full = shard.victim;
+                inserted = shard.approximateInsert(hash);
+                if (inserted && ! full && shard.victim && ! m_full_warned.exchange(true))
+                    std::cout << "Warning: the duplicate filter is full, new keys are not remembered anymore. Increase its memory budget." << std::endl;
+            } else {
+                inserted = shard.exactInsert(hash, values, count);
+            }
+        }
+
+        if (inserted)
+            m_inserted++;
+        else
+            m_duplicates++;
+
+        return inserted;
+    }
+
+    void DuplicateFilter::convert(Shard& shard) {
+        // As many buckets as the budget allows, but at least enough for the keys already seen
+        std::size_t buckets = 1;
+        while (2 * buckets * kBucketSize * sizeof(uint16_t) <= m_shard_budget)
+            buckets *= 2;
+        while (buckets * kBucketSize < 2 * shard.count)
+            buckets *= 2;
+
+        shard.approximate = true;
+        shard.fingerprints.assign(buckets * kBucketSize, 0);
+        shard.mask = buckets - 1;
+
+        std::vector<uint64_t> keys;
+        keys.swap(shard.keys);
+        std::vector<std::size_t>().swap(shard.positions);
+        std::vector<uint64_t>().swap(shard.values);
+        shard.count = 0;
+        for (uint64_t key: keys) {
+            if (key)
+                shard.approximateInsert(key);
+        }
+    }
+
+    void DuplicateFilter::clear() {
+        for (auto& shard: m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->reset();
+        }
+
+        m_inserted = 0;
+        m_duplicates = 0;
+        m_full_warned = false;
+    }
+
+    bool DuplicateFilter::exact() const {
+        for (const auto& shard: m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            if (shard->approximate)
+                return false;
+        }
+        return true;
+    }
+
+    std::size_t DuplicateFilter::memory() const {
+        std::size_t size = 0;
+        for (const auto& shard: m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            size += shard->memory();
+        }
+        return size;
+    }
+};
@@ -0,0 +1,85 @@
+#include <vector>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/FilePrefetcher.h"
+#else
+#include <FilePrefetcher.h>
+#endif
+
+namespace {
+    // Position and size of the baskets of <branch> and its sub-branches starting before <last>
+    void collectBaskets(TBranch* branch, Long64_t last, std::vector<Long64_t>& positions, std::vector<Int_t>& sizes) {
+        const Long64_t* basket_entry = branch->GetBasketEntry();
+        const Int_t* basket_bytes = branch->GetBasketBytes();
+        for (int i = 0; i < branch->GetWriteBasket() && basket_entry[i] < last; i++) {
+            positions.push_back(branch->GetBasketSeek(i));
+            sizes.push_back(basket_bytes[i]);
+        }
+
+        TObjArray* branches = branch->GetListOfBranches();
+        for (int i = 0; i < branches->GetEntriesFast(); i++)
+            collectBaskets(static_cast<TBranch*>(branches->UncheckedAt(i)), last, positions, sizes);
+    }
+}
+
+namespace ROOT {
+    FilePrefetcher::~FilePrefetcher() {
+        release();
+    }
+
+    void FilePrefetcher::prefetch(const std::string& fileName, const std::string& treeName, const std::vector<std::string>& branches) {
+        release();
+
+        m_file_name = fileName;
+        m_file = std::async(std::launch::async, [fileName, treeName, branches]() -> TFile* {
+            TFile* file = TFile::Open(fileName.c_str(), "READ");
+            if (! file || file->IsZombie()) {
+                delete file;
+                return nullptr;
+            }
+
+            // Read the keys and the tree metadata. The tree is owned by the file.
+            TTree* tree = dynamic_cast<TTree*>(file->Get(treeName.c_str()));
+            if (! tree)
+                return file;
+
+            TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+            clusters.Next();
+            Long64_t last = clusters.GetNextEntry();
+
+            std::vector<Long64_t> positions;
+            std::vector<Int_t> sizes;
+            for (const auto& name: branches) {
+                TBranch* branch = tree->GetBranch(name.c_str());
+                if (branch)
+                    collectBaskets(branch, last, positions, sizes);
+            }
+
+            if (! positions.empty()) {
+                Long64_t total = 0;
+                for (Int_t size: sizes)
+                    total += size;
+
+                // One vectored read for all the baskets
+                std::vector<char> buffer(total);
+                file->ReadBuffers(buffer.data(), positions.data(), sizes.data(), positions.size());
+            }
+
+            return file;
+        });
+    }
+
+    void FilePrefetcher::release() {
+        if (m_file.valid()) {
+            TFile* file = m_file.get();
+            if (file)
+                file->Close();
+            delete file;
+        }
+
+        m_file_name.clear();
+    }
+};
@@ -1,3 +1,8 @@
+#include <cstring>
+
+#include <TFile.h>
+#include <TKey.h>
+
 #ifdef FROM_CMSSW
 #include "../interface/Leaf.h"
 #else
@@ -10,4 +15,60 @@ namespace ROOT {
         m_tree(tree) {
 
         }
+
+    int Leaf::getCachedEntry(int64_t entry, uint64_t owner) {
+        TTree* tree = m_branch->GetTree();
+
+        TFile* file = tree->GetCurrentFile();
+        if (! file) {
+            // An in-memory tree has no identity another reader could share, and nothing to decompress
+            return m_branch->GetEntry(entry);
+        }
+
+        if (! m_block || m_block_tree != tree || entry < m_block->first || entry >= m_block->last) {
+            TTree::TClusterIterator clusters = tree->GetClusterIterator(entry);
+            int64_t first = clusters.Next();
+            int64_t last = clusters.GetNextEntry();
+
+            // The UUID is unique to each file ever written, and the cycle to each version of the tree saved in it: a
+            // file rewritten in place, or a tree saved again, never reuses the blocks of the previous one
+            TDirectory* directory = tree->GetDirectory();
+            std::string tree_name = directory ? directory->GetPath() : file->GetName();
+            tree_name += "/";
+            tree_name += tree->GetName();
+            TKey* tree_key = directory ? directory->GetKey(tree->GetName()) : nullptr;
+            if (tree_key)
+                tree_name += ";" + std::to_string(tree_key->GetCycle());
+
+            std::string key = ClusterCache::key(file->GetUUID().AsString(), tree_name, m_name, first);
+
+            ClusterCache& cache = ClusterCache::instance();
+            std::shared_ptr<const ClusterBlock> block = cache.get(key);
+            if (! block) {
+                std::shared_ptr<ClusterBlock> decoded(new ClusterBlock());
+                decoded->first = first;
+                decoded->last = last;
+                decoded->elementSize = m_raw_size;
+                decoded->data.resize((last - first) * m_raw_size);
+
+                char* output = decoded->data.data();
+                for (int64_t i = first; i < last; i++) {
+                    int res = m_branch->GetEntry(i);
+                    if (res <= 0)
+                        return res;
+
+                    std::memcpy(output, m_raw_data, m_raw_size);
+                    output += m_raw_size;
+                }
+
+                block = cache.put(key, decoded, owner);
+            }
+
+            m_block = block;
+            m_block_tree = tree;
+        }
+
+        std::memcpy(m_raw_data, m_block->at(entry), m_raw_size);
+        return m_raw_size;
+    }
 };
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <TBasket.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+
+#ifdef FROM_CMSSW
+#include "../interface/MemoryReport.h"
+#else
+#include <MemoryReport.h>
+#endif
+
+namespace {
+    std::string humanSize(std::size_t bytes) {
+        static const char* units[] = {"B", "kB", "MB", "GB", "TB"};
+
+        double size = bytes;
+        std::size_t unit = 0;
+        while (size >= 1024 && unit < 4) {
+            size /= 1024;
+            unit++;
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(unit ? 1 : 0) << size << " " << units[unit];
+        return out.str();
+    }
+}
+
+namespace ROOT {
+    namespace utils {
+        std::size_t basketMemory(TBranch* branch) {
+            std::size_t size = 0;
+
+            TObjArray* baskets = branch->GetListOfBaskets();
+            if (baskets) {
+                const std::size_t nBaskets = baskets->GetEntriesFast();
+                for (std::size_t i = 0; i != nBaskets; ++i) {
+                    TBasket* basket = static_cast<TBasket*>(baskets->UncheckedAt(i));
+                    if (basket)
+                        size += basket->GetBufferSize();
+                }
+            }
+
+            TObjArray* branches = branch->GetListOfBranches();
+            if (branches) {
+                const std::size_t nBranches = branches->GetEntriesFast();
+                for (std::size_t i = 0; i != nBranches; ++i)
+                    size += basketMemory(static_cast<TBranch*>(branches->UncheckedAt(i)));
+            }
+
+            return size;
+        }
+    }
+
+    void MemoryReport::print(std::ostream& out/* = std::cout*/, std::size_t maxBranches/* = 20*/) const {
+        out << "Memory report: " << humanSize(total());
+        if (budget)
+            out << " (budget: " << humanSize(budget) << ")";
+        out << std::endl;
+
+        out << "  buffers:       " << humanSize(buffers) << std::endl;
+        out << "  baskets:       " << humanSize(baskets) << std::endl;
+        out << "  tree cache:    " << humanSize(treeCache) << std::endl;
+        out << "  cluster cache: " << humanSize(clusterCache) << std::endl;
+
+        if (branches.empty())
+            return;
+
+        out << "  largest branches:" << std::endl;
+        for (std::size_t i = 0; i != std::min(maxBranches, branches.size()); ++i) {
+            const BranchMemory& branch = branches[i];
+            out << "    " << std::setw(10) << humanSize(branch.total()) << "  " << branch.name
+                << " (buffer: " << humanSize(branch.buffer) << ", baskets: " << humanSize(branch.baskets) << ")" << std::endl;
+        }
+    }
+};
@@ -0,0 +1,99 @@
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifdef FROM_CMSSW
+#include "../interface/ParallelReduction.h"
+#else
+#include <ParallelReduction.h>
+#endif
+
+namespace ROOT {
+    namespace parallel {
+        namespace {
+            struct SlotIds {
+                std::mutex mutex;
+                std::size_t next_index = 0;
+                uint64_t next_serial = 0;
+                std::vector<std::size_t> free_indices;
+            };
+
+            // Function-local, so that it is usable from the constructor of a global instance
+            SlotIds& slotIds() {
+                static SlotIds s_ids;
+                return s_ids;
+            }
+
+            struct ThreadSlot {
+                void* slot = nullptr;
+                uint64_t serial = 0;
+            };
+        }
+
+        SlotId newSlotId() {
+            SlotIds& ids = slotIds();
+            std::lock_guard<std::mutex> lock(ids.mutex);
+
+            SlotId id;
+            if (ids.free_indices.empty()) {
+                id.index = ids.next_index++;
+            } else {
+                id.index = ids.free_indices.back();
+                ids.free_indices.pop_back();
+            }
+            // Start at 1, so that an unused thread slot never matches
+            id.serial = ++ids.next_serial;
+
+            return id;
+        }
+
+        void releaseSlotId(const SlotId& id) {
+            SlotIds& ids = slotIds();
+            std::lock_guard<std::mutex> lock(ids.mutex);
+            ids.free_indices.push_back(id.index);
+        }
+
+        void*& threadSlot(const SlotId& id) {
+            thread_local std::vector<ThreadSlot> t_slots;
+            if (id.index >= t_slots.size())
+                t_slots.resize(id.index + 1);
+
+            ThreadSlot& slot = t_slots[id.index];
+            if (slot.serial != id.serial) {
+                // Left by a destroyed instance with the same index: its object is gone
+                slot.slot = nullptr;
+                slot.serial = id.serial;
+            }
+
+            return slot.slot;
+        }
+    }
+
+    ParallelBins::Slot::Slot(std::size_t nBins) {
+        const std::size_t padding = parallel::kCacheLine / sizeof(double);
+
+        storage.resize(nBins + 2 + 2 * padding, 0);
+        sums = storage.data() + padding;
+    }
+
+    ParallelBins::ParallelBins(std::size_t nBins, double min, double max):
+        m_bins(nBins),
+        m_min(min),
+        m_max(max),
+        m_scale(nBins / (max - min)),
+        m_slots([nBins]() { return std::unique_ptr<Slot>(new Slot(nBins)); }) {
+
+            if (! nBins || ! (max > min))
+                throw std::runtime_error("ParallelBins: invalid binning");
+        }
+
+    std::vector<double> ParallelBins::merge() {
+        std::vector<double> result(m_bins + 2, 0);
+        m_slots.forEach([&result](Slot& slot) {
+                for (std::size_t i = 0; i != result.size(); ++i)
+                    result[i] += slot.sums[i];
+                });
+
+        return result;
+    }
+};
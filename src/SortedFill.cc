@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#ifdef FROM_CMSSW
+#include "../interface/SortedFill.h"
+#else
+#include <SortedFill.h>
+#endif
+
+namespace ROOT {
+    SortedFill::SortedFill(std::size_t capacity, const std::vector<std::string>& keys):
+        m_capacity(std::max<std::size_t>(capacity, 1)),
+        m_keys(keys) {
+
+        }
+
+    SortedFill::~SortedFill() {
+        if (m_size)
+            std::cout << "Warning: " << m_size << " entries buffered for a sorted fill were never written. Call TreeWrapper::flush before writing the tree." << std::endl;
+    }
+
+    void SortedFill::setColumns(std::vector<std::unique_ptr<SnapshotColumn>> columns, const std::vector<std::size_t>& keys) {
+        if (m_size)
+            throw std::runtime_error("The columns of a sorted fill cannot change while entries are buffered");
+
+        m_columns = std::move(columns);
+        m_key_columns = keys;
+    }
+
+    void SortedFill::save() {
+        for (auto& column: m_columns)
+            column->save();
+        m_size++;
+    }
+
+    void SortedFill::flush(const std::function<void()>& fill) {
+        if (! m_size)
+            return;
+
+        std::vector<std::size_t> order(m_size);
+        std::iota(order.begin(), order.end(), 0);
+
+        std::stable_sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) {
+                for (std::size_t key: m_key_columns) {
+                    const SnapshotColumn& column = *m_columns[key];
+                    if (column.less(a, b))
+                        return true;
+                    if (column.less(b, a))
+                        return false;
+                }
+                return false;
+                });
+
+        for (std::size_t index: order) {
+            for (auto& column: m_columns)
+                column->restore(index);
+            fill();
+        }
+
+        // Leave the buffers as the user last set them
+        for (auto& column: m_columns) {
+            column->restore(m_size - 1);
+            column->clear();
+        }
+        m_size = 0;
+    }
+
+    std::size_t SortedFill::memory() const {
+        std::size_t size = 0;
+        for (const auto& column: m_columns)
+            size += column->memory();
+
+        return size;
+    }
+};
@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <sstream>
+#include <thread>
 
+#include <Compression.h>
 #include <TChain.h>
+#include <TChainElement.h>
+#include <TFile.h>
+#include <TROOT.h>
 #include <TTree.h>
 
 #ifdef FROM_CMSSW
@@ -24,25 +32,154 @@ namespace ROOT {
 
         }
 
-    TreeWrapper::TreeWrapper(const TreeWrapper& o) {
-        m_tree = o.m_tree;
-        m_chain = o.m_chain;
+    TreeWrapper::TreeWrapper(const TreeWrapper& o):
+        m_tree(o.m_tree),
+        m_chain(o.m_chain),
+        m_entry(o.m_entry),
+        m_stop_at(o.m_stop_at),
+        m_stop_at_set(o.m_stop_at_set),
+        m_cleaned(o.m_cleaned),
+        m_shared_cache(o.m_shared_cache),
+        m_follow(o.m_follow),
+        m_follow_poll(o.m_follow_poll),
+        m_follow_timeout(o.m_follow_timeout),
+        m_parallel_threads(o.m_parallel_threads),
+        m_branch_options(o.m_branch_options),
+        m_write_policy(o.m_write_policy),
+        m_filled(o.m_filled),
+        m_sorted_fill(o.m_sorted_fill),
+        m_stats_recorder(o.m_stats_recorder),
+        m_stats_leafs(o.m_stats_leafs),
+        m_cluster_predicates(o.m_cluster_predicates),
+        m_duplicate_filter(o.m_duplicate_filter),
+        m_duplicate_keys(o.m_duplicate_keys),
+        m_memory_budget(o.m_memory_budget) {
+        // The filter is now shared
+        o.m_duplicate_filter_owned = false;
+        // Leafs are shared with o
         m_leafs = o.m_leafs;
+        m_leaf_order = o.m_leaf_order;
         m_varrGroups = o.m_varrGroups;
+        m_friends = o.m_friends;
     }
 
-    TreeWrapper::TreeWrapper(TreeWrapper&& o) {
-        m_tree = o.m_tree;
-        m_chain = o.m_chain;
+    TreeWrapper::TreeWrapper(TreeWrapper&& o):
+        m_tree(o.m_tree),
+        m_chain(o.m_chain),
+        m_entry(o.m_entry),
+        m_stop_at(o.m_stop_at),
+        m_stop_at_set(o.m_stop_at_set),
+        m_cleaned(o.m_cleaned),
+        m_shared_cache(o.m_shared_cache),
+        m_cache_owner(o.m_cache_owner),
+        m_follow(o.m_follow),
+        m_follow_poll(o.m_follow_poll),
+        m_follow_timeout(o.m_follow_timeout),
+        m_parallel_threads(o.m_parallel_threads),
+        m_branch_options(std::move(o.m_branch_options)),
+        m_write_policy(o.m_write_policy),
+        m_filled(o.m_filled),
+        m_sorted_fill(o.m_sorted_fill),
+        m_stats_recorder(o.m_stats_recorder),
+        m_stats_leafs(o.m_stats_leafs),
+        m_cluster_predicates(o.m_cluster_predicates),
+        m_duplicate_filter(o.m_duplicate_filter),
+        m_duplicate_filter_owned(o.m_duplicate_filter_owned),
+        m_duplicate_keys(o.m_duplicate_keys),
+        m_memory_budget(o.m_memory_budget) {
+        o.m_cache_owner = 0;
         m_leafs = std::move(o.m_leafs);
+        m_leaf_order = std::move(o.m_leaf_order);
         m_varrGroups = std::move(o.m_varrGroups);
+        m_friends = std::move(o.m_friends);
+
+        // Leafs now belong to this instance
+        for (auto& leaf: m_leafs)
+            leaf.second->m_tree = this;
+        for (auto& vGroup: m_varrGroups) {
+            vGroup.second->m_wrapper = this;
+            vGroup.second->m_lengthLeaf->m_tree = this;
+            for (auto& leaf: vGroup.second->m_leafs)
+                leaf.second->m_tree = this;
+        }
+    }
+
+    TreeWrapper::~TreeWrapper() {
+        if (m_cache_owner)
+            ClusterCache::instance().releaseOwner(m_cache_owner);
+    }
+
+    std::unique_ptr<TreeWrapper> TreeWrapper::cloneFor(TTree* tree, const std::vector<TTree*>& friends/* = std::vector<TTree*>()*/) const {
+        if (friends.size() < m_friends.size())
+            throw std::runtime_error("cloneFor: a tree must be given for each friend");
+
+        std::unique_ptr<TreeWrapper> clone(new TreeWrapper());
+        clone->m_shared_cache = m_shared_cache;
+        clone->m_branch_options = m_branch_options;
+        clone->m_write_policy = m_write_policy;
+        if (m_parallel_threads)
+            clone->setParallelRead(m_parallel_threads);
+        if (m_preopen)
+            clone->setPreopenNextFile(true, m_preopen_fraction);
+        if (m_memory_budget)
+            clone->setMemoryBudget(m_memory_budget);
+        if (m_sorted_fill)
+            clone->setSortedFill(m_sorted_fill->capacity(), m_sorted_fill->keys());
+        if (m_stats_recorder)
+            clone->recordClusterStats(m_stats_recorder->names(), m_stats_recorder->granularity());
+        clone->m_cluster_predicates = m_cluster_predicates;
+        if (m_duplicate_filter) {
+            clone->removeDuplicates(m_duplicate_keys, m_duplicate_filter);
+            m_duplicate_filter_owned = false;
+        }
+
+        // In registration order, so that computed columns are defined after the columns they use
+        for (const std::string& name: m_leaf_order) {
+            auto leaf = m_leafs.find(name);
+            if (leaf != m_leafs.end() && leaf->second->m_replay)
+                leaf->second->m_replay((*clone)[name]);
+        }
+
+        for (auto& vGroup: m_varrGroups)
+            clone->m_varrGroups[vGroup.first] = vGroup.second->clone(*clone);
+
+        clone->init(tree);
+
+        // Once the tree is known: follow mode is refused for a TChain
+        if (m_follow)
+            clone->follow(true, m_follow_poll, m_follow_timeout);
+
+        for (size_t i = 0; i < m_friends.size(); i++) {
+            const Friend& f = m_friends[i];
+
+            Friend cloned = f;
+            cloned.wrapper = f.wrapper->cloneFor(friends[i]);
+            cloned.key_tree = nullptr;
+            cloned.major_leaf = nullptr;
+            cloned.minor_leaf = nullptr;
+
+            if (! f.major.empty() && ! friends[i]->GetTreeIndex())
+                friends[i]->BuildIndex(f.major.c_str(), f.minor.empty() ? "0" : f.minor.c_str());
+
+            clone->m_friends.push_back(cloned);
+        }
+
+        return clone;
     }
 
     void TreeWrapper::init(TTree* tree) {
         m_tree = tree;
         m_chain = dynamic_cast<TChain*>(tree);
-        if (m_chain)
+        m_branch_index.invalidate();
+        m_cluster_stats_loaded = false;
+        m_skip_checked_first = m_skip_checked_last = 0;
+        m_duplicate_leafs.clear();
+        if (m_chain) {
             m_chain->LoadTree(0);
+            onTreeChanged();
+        } else {
+            applyImplicitMT();
+        }
 
         for (auto& leaf: m_leafs)
             leaf.second->init(this);
@@ -56,12 +193,39 @@ namespace ROOT {
      * returns true in case of success, or false if the end of the tree is reached
      */
     bool TreeWrapper::next(bool readall/* = false*/) {
-        uint64_t stop_at = getStopAt();
+        while (true) {
+            uint64_t stop_at = getStopAt();
 
-        if (m_entry >= stop_at)
-            return false;
+            if (! m_cluster_predicates.empty())
+                m_entry = skipClusters(m_entry, stop_at);
+
+            if (m_entry >= stop_at) {
+                if (! m_follow || m_stop_at_set || ! waitForEntries()) {
+                    if (! m_checkpoint_path.empty())
+                        saveCheckpoint();
+                    return false;
+                }
+            }
+
+            // Duplicates are skipped before any other branch is read
+            if (! m_duplicate_filter || isNewKey(m_entry))
+                break;
+            m_entry++;
+        }
+
+        const bool new_cluster = ! m_checkpoint_path.empty() && m_entry >= m_checkpoint_at;
+        if (new_cluster && std::chrono::steady_clock::now() - m_checkpoint_last >= m_checkpoint_interval)
+            saveCheckpoint();
 
         bool result = getEntry(m_entry, readall);
+
+        if (new_cluster && result) {
+            TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+            TTree::TClusterIterator clusters = tree->GetClusterIterator(m_local_entry);
+            clusters.Next();
+            m_checkpoint_at = m_entry - m_local_entry + clusters.GetNextEntry();
+        }
+
         m_entry++;
 
         return result;
@@ -71,13 +235,13 @@ namespace ROOT {
 
         if (! m_cleaned) {
             for (auto it = m_leafs.begin(); it != m_leafs.end(); ) {
-                if (it->second->getBranch() == nullptr) {
+                if (it->second->getBranch() == nullptr && ! it->second->m_lazy && ! it->second->m_compute) {
                     it = m_leafs.erase(it);
                 } else
                     ++it;
             }
             for (auto& vGroup : m_varrGroups) {
-              for (auto it = vGroup.second->m_leafs.begin(); vGroup.second->m_leafs.end() != it; ++it) {
+              for (auto it = vGroup.second->m_leafs.begin(); vGroup.second->m_leafs.end() != it; ) {
                 if ( ! it->second->getBranch() ) {
                   it = vGroup.second->m_leafs.erase(it);
                 } else {
@@ -89,13 +253,23 @@ namespace ROOT {
             m_cleaned = true;
         }
 
+        uint64_t local_entry = entry;
         if (readall) {
             if (! m_tree->GetEntry(entry, 1))
                 return false;
+
+            if (m_chain) {
+                if (m_chain->GetTreeNumber() != m_tree_number)
+                    onTreeChanged();
+                local_entry = entry - m_tree_first;
+            }
+
+            for ( auto& vGroup : m_varrGroups ) {
+              vGroup.second->getEntry(local_entry, readall);
+            }
         } else {
-            uint64_t local_entry = entry;
             if (m_chain) {
-                int64_t tree_index = m_chain->LoadTree(local_entry);
+                int64_t tree_index = loadTree(entry);
                 if (tree_index < 0) {
                     std::cerr << "ERROR: LoadTree failed. Return code: " << tree_index << std::endl;
                     return false;
@@ -104,22 +278,247 @@ namespace ROOT {
                 local_entry = static_cast<uint64_t>(tree_index);
             }
 
-            for (auto& leaf: m_leafs) {
-                int res = leaf.second->getBranch()->GetEntry(local_entry);
-                if (res <= 0) {
-                    std::cerr << "ERROR: GetEntry failed for branch " << leaf.first << ". Return code: " << res << std::endl;
+            if (m_parallel_threads && enterCluster(local_entry)) {
+                if (! readParallel(local_entry))
                     return false;
+            } else {
+                for (auto& leaf: m_leafs) {
+                    if (! readLeaf(*leaf.second, local_entry))
+                        return false;
+                }
+                for ( auto& vGroup : m_varrGroups ) {
+                  vGroup.second->getEntry(local_entry, readall);
                 }
             }
         }
-        for ( auto& vGroup : m_varrGroups ) {
-          vGroup.second->getEntry(entry, readall);
+
+        // Lazy and computed leafs are fetched against this entry
+        m_local_entry = local_entry;
+        m_serial++;
+
+        for (auto& f: m_friends) {
+            TreeWrapper& wrapper = *f.wrapper;
+            if (wrapper.m_leafs.empty() && wrapper.m_varrGroups.empty())
+                continue;
+
+            int64_t friend_entry = entry;
+            if (! f.major.empty())
+                friend_entry = getFriendEntry(f, local_entry);
+
+            if (friend_entry < 0) {
+                wrapper.reset();
+                continue;
+            }
+
+            if (! wrapper.getEntry(friend_entry, readall))
+                return false;
+        }
+
+        if (m_memory_budget && entry >= m_budget_check_at) {
+            enforceMemoryBudget();
+
+            // Check again when entering the next cluster
+            TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+            TTree::TClusterIterator clusters = tree->GetClusterIterator(local_entry);
+            clusters.Next();
+            m_budget_check_at = entry - local_entry + clusters.GetNextEntry();
         }
 
         m_entry = entry;
         return true;
     }
 
+    bool TreeWrapper::readLeaf(Leaf& leaf, uint64_t localEntry) {
+        // Read on demand, see <define>
+        if (leaf.m_lazy || leaf.m_compute)
+            return true;
+
+        int res;
+        if (m_shared_cache && ! m_follow && leaf.m_raw_data) {
+            if (! m_cache_owner)
+                m_cache_owner = ClusterCache::instance().newOwner();
+            res = leaf.getCachedEntry(localEntry, m_cache_owner);
+        } else {
+            res = leaf.getBranch()->GetEntry(localEntry);
+        }
+        if (res <= 0) {
+            std::cerr << "ERROR: GetEntry failed for branch " << leaf.name() << ". Return code: " << res << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool TreeWrapper::enterCluster(uint64_t localEntry) {
+        TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+        int64_t entry = localEntry;
+        if (tree == m_cluster_tree && entry >= m_cluster_first && entry < m_cluster_last)
+            return false;
+
+        TTree::TClusterIterator clusters = tree->GetClusterIterator(entry);
+        m_cluster_first = clusters.Next();
+        m_cluster_last = clusters.GetNextEntry();
+        m_cluster_tree = tree;
+
+        return true;
+    }
+
+    bool TreeWrapper::readParallel(uint64_t localEntry) {
+        // Only the registered branches are active. With implicit multi-threading, ROOT reads them concurrently and
+        // serializes the accesses to the file and to the TTreeCache itself.
+        TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+        int res = tree->GetEntry(localEntry);
+        if (res < 0) {
+            std::cerr << "ERROR: GetEntry failed. Return code: " << res << std::endl;
+            return false;
+        }
+
+        // The branches of the groups are read already
+        for (auto& vGroup: m_varrGroups)
+            vGroup.second->getEntry(localEntry, true);
+
+        return true;
+    }
+
+    void TreeWrapper::setParallelRead(size_t threads) {
+        if (threads)
+            ROOT::EnableImplicitMT(threads);
+
+        m_parallel_threads = threads;
+        m_cluster_tree = nullptr;
+        applyImplicitMT();
+    }
+
+    void TreeWrapper::applyImplicitMT() {
+        if (! m_parallel_threads)
+            return;
+
+        if (m_tree)
+            m_tree->SetImplicitMT(true);
+        if (m_chain && m_chain->GetTree())
+            m_chain->GetTree()->SetImplicitMT(true);
+    }
+
+    void TreeWrapper::follow(bool enable, unsigned int pollMs/* = 1000*/, unsigned int timeoutMs/* = 0*/) {
+        // Each check reloads the tree metadata from the file, never do it in a tight loop
+        static const unsigned int kMinPollMs = 10;
+
+        if (enable && m_chain)
+            throw std::runtime_error("Follow mode is not available for a TChain");
+
+        m_follow = enable;
+        m_follow_poll = std::max(pollMs, kMinPollMs);
+        m_follow_timeout = timeoutMs;
+        m_stop_following = false;
+    }
+
+    bool TreeWrapper::waitForEntries() {
+        // Sleep by small slices, to react quickly to stopFollowing
+        static const unsigned int kSliceMs = 50;
+
+        auto last_entries = std::chrono::steady_clock::now();
+        bool first = true;
+        while (! m_stop_following) {
+            if (! first) {
+                for (unsigned int slept = 0; slept < m_follow_poll && ! m_stop_following; slept += kSliceMs)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(kSliceMs, m_follow_poll - slept)));
+            }
+            first = false;
+
+            m_tree->Refresh();
+            uint64_t entries = getEntries();
+            if (entries > m_entry) {
+                // Let the TTreeCache prefetch the new entries too
+                m_tree->SetCacheEntryRange(m_entry, entries);
+                return true;
+            }
+
+            auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_entries);
+            if (m_follow_timeout && waited.count() >= m_follow_timeout)
+                return false;
+        }
+
+        return false;
+    }
+
+    void TreeWrapper::setCheckpoint(const std::string& path, unsigned int intervalSeconds/* = 60*/, std::function<void(std::ostream&)> save/* = nullptr*/) {
+        m_checkpoint_path = path;
+        m_checkpoint_interval = std::chrono::seconds(intervalSeconds);
+        m_checkpoint_save = save;
+        m_checkpoint_last = std::chrono::steady_clock::now();
+        m_checkpoint_at = 0;
+    }
+
+    void TreeWrapper::saveCheckpoint() {
+        Checkpoint checkpoint;
+        checkpoint.entry = m_entry;
+        checkpoint.stopAt = m_stop_at;
+        checkpoint.stopAtSet = m_stop_at_set;
+        checkpoint.entries = getEntries();
+
+        if (m_chain && m_tree_number >= 0) {
+            checkpoint.treeNumber = m_tree_number;
+            checkpoint.fileName = m_chain->GetListOfFiles()->UncheckedAt(m_tree_number)->GetTitle();
+        } else if (! m_chain && m_tree->GetCurrentFile()) {
+            checkpoint.fileName = m_tree->GetCurrentFile()->GetName();
+        }
+
+        if (m_checkpoint_save) {
+            std::ostringstream user;
+            m_checkpoint_save(user);
+            checkpoint.user = user.str();
+        }
+
+        checkpoint.write(m_checkpoint_path);
+        m_checkpoint_last = std::chrono::steady_clock::now();
+    }
+
+    bool TreeWrapper::resume(const std::string& path, std::function<void(std::istream&)> restore/* = nullptr*/) {
+        if (m_duplicate_filter)
+            throw std::runtime_error("resume: the keys seen by removeDuplicates are not saved in checkpoints, a loop removing duplicates cannot be resumed");
+
+        Checkpoint checkpoint;
+        if (! checkpoint.read(path))
+            return false;
+
+        if (m_chain && checkpoint.treeNumber >= 0) {
+            TObjArray* files = m_chain->GetListOfFiles();
+            if (checkpoint.treeNumber >= files->GetEntriesFast())
+                throw std::runtime_error("Checkpoint " + path + " was written for a longer chain of files");
+
+            const std::string name = files->UncheckedAt(checkpoint.treeNumber)->GetTitle();
+            if (name != checkpoint.fileName)
+                throw std::runtime_error("Checkpoint " + path + " was written for another chain of files: expected " + checkpoint.fileName + " in position " + std::to_string(checkpoint.treeNumber) + ", found " + name);
+        }
+
+        if (! m_chain && ! checkpoint.fileName.empty()) {
+            const std::string name = m_tree->GetCurrentFile() ? m_tree->GetCurrentFile()->GetName() : "";
+            if (name != checkpoint.fileName)
+                throw std::runtime_error("Checkpoint " + path + " was written for another file: expected " + checkpoint.fileName + ", found " + (name.empty() ? "a tree in memory" : name));
+        }
+
+        // A tree being followed can only grow
+        const uint64_t entries = getEntries();
+        if (checkpoint.entries && (m_follow ? entries < checkpoint.entries : entries != checkpoint.entries))
+            throw std::runtime_error("Checkpoint " + path + " was written for a tree of " + std::to_string(checkpoint.entries) + " entries, found " + std::to_string(entries));
+
+        if (checkpoint.entry > entries || (checkpoint.stopAtSet && checkpoint.stopAt > entries))
+            throw std::runtime_error("Checkpoint " + path + " resumes at entry " + std::to_string(checkpoint.entry) + ", beyond the " + std::to_string(entries) + " entries of the tree");
+
+        m_entry = checkpoint.entry;
+        m_stop_at = checkpoint.stopAt;
+        m_stop_at_set = checkpoint.stopAtSet;
+        m_checkpoint_at = 0;
+        m_resumed = true;
+
+        if (restore) {
+            std::istringstream user(checkpoint.user);
+            restore(user);
+        }
+
+        return true;
+    }
+
     void TreeWrapper::setEntry(uint64_t entry) {
         uint64_t stop_at = getStopAt();
 
@@ -137,13 +536,557 @@ namespace ROOT {
             m_stop_at = entry + 1;
     }
 
+    void TreeWrapper::addFriend(TTree* tree, const std::string& alias/* = ""*/) {
+        addFriend(tree, alias, "", "");
+    }
+
+    void TreeWrapper::addFriend(TTree* tree, const std::string& alias, const std::string& major, const std::string& minor/* = ""*/) {
+        Friend f;
+        f.alias = alias;
+        f.wrapper.reset(new TreeWrapper(tree));
+        f.major = major;
+        f.minor = minor;
+        f.key_tree = nullptr;
+        f.major_leaf = nullptr;
+        f.minor_leaf = nullptr;
+
+        if (! major.empty() && ! tree->GetTreeIndex())
+            tree->BuildIndex(major.c_str(), minor.empty() ? "0" : minor.c_str());
+
+        m_friends.push_back(f);
+    }
+
+    TreeWrapper* TreeWrapper::findFriend(const std::string& name, std::string& localName) {
+        for (auto& f: m_friends) {
+            if (! f.alias.empty() && name.size() > f.alias.size() && name.compare(0, f.alias.size(), f.alias) == 0 && name[f.alias.size()] == '.') {
+                localName = name.substr(f.alias.size() + 1);
+                return f.wrapper.get();
+            }
+        }
+
+        for (auto& f: m_friends) {
+            if (f.wrapper->m_leafs.count(name)) {
+                localName = name;
+                return f.wrapper.get();
+            }
+        }
+
+        if (! m_tree || branchIndex().branch(name))
+            return nullptr;
+
+        for (auto& f: m_friends) {
+            if (f.wrapper->m_tree && f.wrapper->branchIndex().branch(name)) {
+                localName = name;
+                return f.wrapper.get();
+            }
+        }
+
+        return nullptr;
+    }
+
+    int64_t TreeWrapper::getFriendEntry(Friend& f, uint64_t localEntry) {
+        TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+        if (f.key_tree != tree) {
+            f.key_tree = tree;
+            f.major_leaf = tree->GetLeaf(f.major.c_str());
+            f.minor_leaf = f.minor.empty() ? nullptr : tree->GetLeaf(f.minor.c_str());
+
+            if (! f.major_leaf || (! f.minor.empty() && ! f.minor_leaf)) {
+                std::cerr << "ERROR: index leaves of friend '" << f.alias << "' not found in tree" << std::endl;
+                f.major_leaf = nullptr;
+            }
+        }
+
+        if (! f.major_leaf)
+            return -1;
+
+        // Key branches may be disabled, force the read
+        f.major_leaf->GetBranch()->GetEntry(localEntry, 1);
+        int64_t major = f.major_leaf->GetValueLong64();
+        int64_t minor = 0;
+        if (f.minor_leaf) {
+            f.minor_leaf->GetBranch()->GetEntry(localEntry, 1);
+            minor = f.minor_leaf->GetValueLong64();
+        }
+
+        return f.wrapper->m_tree->GetEntryNumberWithIndex(major, minor);
+    }
+
+    void TreeWrapper::optimizeBranches() {
+        m_tree->FlushBaskets();
+        m_tree->OptimizeBaskets(m_write_policy.basketMemory, 1.1, "");
+
+        TObjArray* branches = m_tree->GetListOfBranches();
+        for (int i = 0; i < branches->GetEntriesFast(); i++) {
+            TBranch* branch = static_cast<TBranch*>(branches->UncheckedAt(i));
+
+            auto it = m_branch_options.find(branch->GetName());
+            if (it != m_branch_options.end() && it->second.compression >= 0)
+                continue;
+
+            double zip = branch->GetZipBytes("*");
+            double factor = (zip > 0) ? branch->GetTotBytes("*") / zip : 1;
+
+            int settings;
+            switch (m_write_policy.target) {
+                case CompressionTarget::Speed:
+                    settings = (factor < 1.2) ? 0 : CompressionSettings(kLZ4, 4);
+                    break;
+
+                case CompressionTarget::Balanced:
+                    settings = (factor < 2) ? CompressionSettings(kLZ4, 4) : CompressionSettings(kZSTD, 5);
+                    break;
+
+                case CompressionTarget::Size:
+                default:
+                    settings = CompressionSettings(kZSTD, 9);
+                    break;
+            }
+
+            branch->SetCompressionSettings(settings);
+        }
+    }
+
+    void TreeWrapper::setSortedFill(size_t entries, const std::vector<std::string>& keys) {
+        if (m_sorted_fill && ! m_sorted_fill->empty())
+            throw std::runtime_error("setSortedFill: entries are still buffered, call flush first");
+
+        if (! entries) {
+            m_sorted_fill.reset();
+            return;
+        }
+
+        m_sorted_fill = std::make_shared<SortedFill>(entries, keys);
+    }
+
+    void TreeWrapper::flush() {
+        if (m_sorted_fill)
+            m_sorted_fill->flush([this]() { fillEntry(); });
+
+        if (m_stats_recorder) {
+            ClusterStats stats;
+            if (m_stats_recorder->build(m_tree, stats))
+                stats.save(m_tree);
+            else
+                std::cout << "Warning: the tree holds entries not filled by TreeWrapper::fill, cluster statistics are not stored" << std::endl;
+        }
+    }
+
+    void TreeWrapper::recordClusterStats(const std::vector<std::string>& branches, size_t granularity/* = 1000*/) {
+        m_stats_leafs.clear();
+        if (branches.empty()) {
+            m_stats_recorder.reset();
+            return;
+        }
+
+        m_stats_recorder = std::make_shared<ClusterStatsRecorder>(branches, granularity);
+    }
+
+    void TreeWrapper::recordStats() {
+        const std::vector<std::string>& names = m_stats_recorder->names();
+        if (m_stats_leafs.empty()) {
+            // Branches may be registered after recordClusterStats, resolve them at the first fill
+            for (const std::string& name: names) {
+                Leaf* leaf = nullptr;
+                auto it = m_leafs.find(name);
+                if (it != m_leafs.end()) {
+                    leaf = it->second.get();
+                } else {
+                    // Length of a group written with VarrLeaf::write, set by VarrGroup::prepareFill before this call
+                    auto vGroup = m_varrGroups.find(name);
+                    if (vGroup != m_varrGroups.end())
+                        leaf = vGroup->second->m_lengthLeaf.get();
+                }
+
+                if (! leaf || ! leaf->m_numeric || ! leaf->getBranch())
+                    throw std::runtime_error("Branch " + name + " is not registered for write with a numeric type, no cluster statistics can be recorded");
+                m_stats_leafs.push_back(leaf);
+            }
+        }
+
+        double low, high;
+        for (size_t i = 0; i < m_stats_leafs.size(); i++) {
+            m_stats_leafs[i]->m_numeric(low, high);
+            m_stats_recorder->add(i, low, high);
+        }
+        m_stats_recorder->endEntry();
+    }
+
+    void TreeWrapper::addClusterPredicate(const std::string& expression) {
+        m_cluster_predicates.push_back(ClusterPredicate::parse(expression));
+        m_cluster_stats_loaded = false;
+        m_skip_checked_first = m_skip_checked_last = 0;
+    }
+
+    void TreeWrapper::clearClusterPredicates() {
+        m_cluster_predicates.clear();
+        m_predicate_columns.clear();
+        m_skip_checked_first = m_skip_checked_last = 0;
+    }
+
+    void TreeWrapper::loadClusterStats() {
+        m_cluster_stats.load(m_chain ? m_chain->GetTree() : m_tree);
+
+        m_predicate_columns.clear();
+        for (const ClusterPredicate& predicate: m_cluster_predicates)
+            m_predicate_columns.push_back(m_cluster_stats.column(predicate.branch));
+
+        m_cluster_stats_loaded = true;
+    }
+
+    uint64_t TreeWrapper::skipClusters(uint64_t entry, uint64_t stopAt) {
+        while (entry < stopAt) {
+            if (entry >= m_skip_checked_first && entry < m_skip_checked_last)
+                return entry;
+
+            const int64_t local_entry = m_chain ? loadTree(entry) : entry;
+            if (local_entry < 0)
+                return entry;
+            if (! m_cluster_stats_loaded)
+                loadClusterStats();
+
+            const uint64_t offset = entry - local_entry;
+            const size_t cluster = m_cluster_stats.find(local_entry);
+            if (cluster == m_cluster_stats.clusters()) {
+                // No statistics: read the rest of the tree normally
+                m_skip_checked_first = entry;
+                m_skip_checked_last = m_chain ? m_tree_last : getEntries();
+                return entry;
+            }
+
+            bool excluded = false;
+            for (size_t i = 0; i < m_cluster_predicates.size() && ! excluded; i++) {
+                if (m_predicate_columns[i] >= 0)
+                    excluded = m_cluster_predicates[i].excludes(m_cluster_stats.range(m_predicate_columns[i], cluster));
+            }
+
+            const uint64_t end = offset + m_cluster_stats.end(cluster);
+            if (! excluded) {
+                m_skip_checked_first = offset + m_cluster_stats.first(cluster);
+                m_skip_checked_last = end;
+                return entry;
+            }
+
+            m_skipped_entries += std::min(end, stopAt) - entry;
+            entry = end;
+        }
+
+        return entry;
+    }
+
+    void TreeWrapper::bufferEntry() {
+        if (m_sorted_fill->empty()) {
+            // Start of a batch: take the branches registered since the previous one into account
+            std::vector<std::unique_ptr<SnapshotColumn>> columns;
+            std::unordered_map<std::string, size_t> positions;
+
+            for (auto& leaf: m_leafs) {
+                if (! leaf.second->m_snapshot || leaf.second->m_compute)
+                    continue;
+                positions[leaf.first] = columns.size();
+                columns.push_back(leaf.second->m_snapshot());
+            }
+
+            for (auto& vGroup: m_varrGroups) {
+                for (auto& leaf: vGroup.second->m_leafs) {
+                    if (! leaf.second->m_snapshot)
+                        continue;
+                    positions[leaf.first] = columns.size();
+                    columns.push_back(leaf.second->m_snapshot());
+                }
+            }
+
+            std::vector<size_t> keys;
+            for (const std::string& key: m_sorted_fill->keys()) {
+                auto it = positions.find(key);
+                if (it == positions.end())
+                    throw std::runtime_error("Sorting key " + key + " is not a branch registered for write");
+                keys.push_back(it->second);
+            }
+
+            m_sorted_fill->setColumns(std::move(columns), keys);
+        }
+
+        m_sorted_fill->save();
+        // Statistics are only built by the user-facing <flush>, once all the entries are filled
+        if (m_sorted_fill->full())
+            m_sorted_fill->flush([this]() { fillEntry(); });
+    }
+
+    std::shared_ptr<DuplicateFilter> TreeWrapper::removeDuplicates(const std::vector<std::string>& keys, std::shared_ptr<DuplicateFilter> filter/* = nullptr*/) {
+        if (keys.empty())
+            throw std::runtime_error("removeDuplicates: at least one key leaf is needed");
+        if (m_resumed)
+            throw std::runtime_error("removeDuplicates: the keys seen before the checkpoint are not saved, a resumed loop cannot remove duplicates");
+
+        m_duplicate_keys = keys;
+        m_duplicate_leafs.clear();
+        m_duplicate_filter = filter ? filter : std::make_shared<DuplicateFilter>();
+        m_duplicate_filter_owned = ! filter;
+
+        return m_duplicate_filter;
+    }
+
+    bool TreeWrapper::isNewKey(uint64_t entry) {
+        const int64_t local_entry = m_chain ? loadTree(entry) : entry;
+        if (local_entry < 0)
+            // Let getEntry report the error
+            return true;
+
+        if (m_duplicate_leafs.empty()) {
+            for (const std::string& key: m_duplicate_keys) {
+                TLeaf* leaf = branchIndex().leaf(key);
+                if (! leaf)
+                    throw std::runtime_error("Duplicate key leaf " + key + " not found in tree");
+                m_duplicate_leafs.push_back(leaf);
+            }
+            m_duplicate_values.resize(m_duplicate_leafs.size());
+        }
+
+        for (size_t i = 0; i < m_duplicate_leafs.size(); i++) {
+            m_duplicate_leafs[i]->GetBranch()->GetEntry(local_entry, 1);
+            m_duplicate_values[i] = m_duplicate_leafs[i]->GetValueLong64();
+        }
+
+        return m_duplicate_filter->insert(m_duplicate_values.data(), m_duplicate_values.size());
+    }
+
+    int64_t TreeWrapper::loadTree(uint64_t entry) {
+        if (entry >= m_tree_first && entry < m_tree_last) {
+            if (m_preopen && ! m_preopen_started && entry >= m_preopen_at)
+                prefetchNextFile();
+
+            // Keep the read entry of the tree current, the TTreeCache and the friends rely on it
+            const int64_t local_entry = entry - m_tree_first;
+            m_chain->GetTree()->LoadTree(local_entry);
+
+            return local_entry;
+        }
+
+        int64_t local_entry = m_chain->LoadTree(entry);
+        if (local_entry >= 0)
+            onTreeChanged();
+
+        return local_entry;
+    }
+
+    void TreeWrapper::rewindDuplicates() {
+        if (m_duplicate_filter_owned) {
+            m_duplicate_filter->clear();
+            return;
+        }
+
+        std::cout << "Warning: the duplicate filter is shared and keeps the keys already seen when rewinding: the entries returned by the previous pass will be skipped." << std::endl;
+    }
+
+    void TreeWrapper::onTreeChanged() {
+        m_branch_index.invalidate();
+        m_cluster_stats_loaded = false;
+        m_duplicate_leafs.clear();
+        m_cluster_tree = nullptr;
+        // Another tree may be allocated at the address of the previous one
+        for (auto& leaf: m_leafs) {
+            leaf.second->m_block.reset();
+            leaf.second->m_block_tree = nullptr;
+        }
+        for (auto& vGroup: m_varrGroups)
+            vGroup.second->invalidateBlock();
+
+        m_tree_number = m_chain->GetTreeNumber();
+        m_tree_first = m_chain->GetChainOffset();
+        m_tree_last = m_tree_first + (m_chain->GetTree() ? m_chain->GetTree()->GetEntries() : 0);
+
+        if (m_max_virtual_size)
+            setMaxVirtualSize();
+        applyImplicitMT();
+
+        if (! m_preopen)
+            return;
+
+        // The chain opened its own handle on the file. No file if the chain reached its end or failed to open it.
+        TFile* file = m_chain->GetCurrentFile();
+        if (m_prefetcher && file && m_prefetcher->fileName() == file->GetName())
+            m_prefetcher->release();
+
+        m_preopen_at = m_tree_first + static_cast<uint64_t>(m_preopen_fraction * (m_tree_last - m_tree_first));
+        m_preopen_started = false;
+    }
+
+    void TreeWrapper::prefetchNextFile() {
+        m_preopen_started = true;
+
+        TObjArray* files = m_chain->GetListOfFiles();
+        if (m_tree_number + 1 >= files->GetEntriesFast())
+            return;
+
+        TChainElement* next = static_cast<TChainElement*>(files->UncheckedAt(m_tree_number + 1));
+        if (! m_prefetcher)
+            m_prefetcher.reset(new FilePrefetcher());
+        m_prefetcher->prefetch(next->GetTitle(), next->GetName(), getBranchNames());
+    }
+
+    void TreeWrapper::setPreopenNextFile(bool enable, double fraction/* = 0.9*/) {
+        if (enable)
+            ROOT::EnableThreadSafety();
+
+        m_preopen = enable;
+        m_preopen_fraction = fraction;
+        if (! enable)
+            m_prefetcher.reset();
+
+        if (m_chain)
+            onTreeChanged();
+    }
+
+    std::vector<std::string> TreeWrapper::getBranchNames() const {
+        std::vector<std::string> names;
+        for (auto& leaf: m_leafs)
+            names.push_back(leaf.first);
+        for (auto& vGroup: m_varrGroups) {
+            names.push_back(vGroup.first);
+            for (auto& leaf: vGroup.second->m_leafs)
+                names.push_back(leaf.first);
+        }
+
+        return names;
+    }
+
+    namespace {
+        // Attribute the compressed size of each basket to the cluster holding its first entry
+        void addBasketSizes(TBranch* branch, uint64_t offset, const std::vector<uint64_t>& starts, std::vector<uint64_t>& bytes) {
+            const Long64_t* basket_entry = branch->GetBasketEntry();
+            const Int_t* basket_bytes = branch->GetBasketBytes();
+            for (int i = 0; i < branch->GetWriteBasket(); i++) {
+                uint64_t entry = offset + basket_entry[i];
+                size_t cluster = std::upper_bound(starts.begin(), starts.end(), entry) - starts.begin() - 1;
+                if (cluster < bytes.size())
+                    bytes[cluster] += basket_bytes[i];
+            }
+
+            TObjArray* branches = branch->GetListOfBranches();
+            for (int i = 0; i < branches->GetEntriesFast(); i++)
+                addBasketSizes(static_cast<TBranch*>(branches->UncheckedAt(i)), offset, starts, bytes);
+        }
+    }
+
+    void TreeWrapper::getClusterSizes(std::vector<uint64_t>& starts, std::vector<uint64_t>& bytes) {
+        std::vector<std::string> names = getBranchNames();
+
+        size_t trees = m_chain ? m_chain->GetNtrees() : 1;
+        uint64_t entries = getEntries();
+        for (size_t i = 0; i < trees; i++) {
+            TTree* tree = m_tree;
+            uint64_t offset = 0;
+            if (m_chain) {
+                offset = m_chain->GetTreeOffset()[i];
+                if (m_chain->LoadTree(offset) < 0)
+                    continue;
+                tree = m_chain->GetTree();
+            }
+
+            std::vector<uint64_t> tree_starts;
+            uint64_t tree_entries = tree->GetEntries();
+            TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+            Long64_t first;
+            while ((first = clusters.Next()) < static_cast<Long64_t>(tree_entries))
+                tree_starts.push_back(offset + first);
+
+            size_t first_cluster = starts.size();
+            starts.insert(starts.end(), tree_starts.begin(), tree_starts.end());
+            bytes.resize(starts.size(), 0);
+
+            // Baskets of this tree are only attributed to its own clusters
+            std::vector<uint64_t> local_bytes(tree_starts.size(), 0);
+            tree_starts.push_back(offset + tree_entries);
+            if (names.empty()) {
+                TObjArray* branches = tree->GetListOfBranches();
+                for (int j = 0; j < branches->GetEntriesFast(); j++)
+                    addBasketSizes(static_cast<TBranch*>(branches->UncheckedAt(j)), offset, tree_starts, local_bytes);
+            } else {
+                for (auto& name: names) {
+                    TBranch* branch = tree->GetBranch(name.c_str());
+                    if (branch)
+                        addBasketSizes(branch, offset, tree_starts, local_bytes);
+                }
+            }
+
+            std::copy(local_bytes.begin(), local_bytes.end(), bytes.begin() + first_cluster);
+        }
+        starts.push_back(entries);
+
+        if (m_chain) {
+            m_chain->LoadTree(m_entry < entries ? m_entry : 0);
+            onTreeChanged();
+        }
+    }
+
+    std::pair<uint64_t, uint64_t> TreeWrapper::shard(size_t index, size_t count) {
+        if (count == 0 || index >= count)
+            throw std::runtime_error("shard: invalid shard index");
+
+        std::vector<uint64_t> starts;
+        std::vector<uint64_t> bytes;
+        getClusterSizes(starts, bytes);
+
+        uint64_t total = 0;
+        for (uint64_t b: bytes)
+            total += b;
+
+        // Without any basket on disk, balance by number of entries
+        if (total == 0) {
+            for (size_t i = 0; i < bytes.size(); i++) {
+                bytes[i] = starts[i + 1] - starts[i];
+                total += bytes[i];
+            }
+        }
+
+        // Each cluster goes to the shard holding the cumulated size at its beginning
+        uint64_t first = starts.back();
+        uint64_t last = starts.back();
+        bool found = false;
+        uint64_t cumulated = 0;
+        for (size_t i = 0; i < bytes.size(); i++) {
+            size_t shard = total ? static_cast<size_t>(static_cast<double>(cumulated) / total * count) : 0;
+            shard = std::min(shard, count - 1);
+            cumulated += bytes[i];
+
+            if (shard < index)
+                continue;
+            if (shard > index)
+                break;
+
+            if (! found) {
+                first = starts[i];
+                found = true;
+            }
+            last = starts[i + 1];
+        }
+
+        if (! found)
+            first = last;
+
+        m_entry = first;
+        m_stop_at = last;
+        m_stop_at_set = true;
+
+        return std::make_pair(first, last);
+    }
+
     Leaf& TreeWrapper::operator[](const std::string& name) {
 
         if (m_leafs.count(name))
             return *m_leafs.at(name);
 
+        if (! m_friends.empty()) {
+            std::string local_name;
+            TreeWrapper* wrapper = findFriend(name, local_name);
+            if (wrapper)
+                return (*wrapper)[local_name];
+        }
+
         std::shared_ptr<Leaf> leaf(new Leaf(name, this));
         m_leafs[name] = leaf;
+        m_leaf_order.push_back(name);
 
         return *leaf;
     }
@@ -151,4 +1094,125 @@ namespace ROOT {
     TreeGroup TreeWrapper::group(const std::string& prefix) {
         return TreeGroup(prefix, *this);
     }
+
+    BranchIndex& TreeWrapper::branchIndex() {
+        TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+        if (! m_branch_index.isFor(tree))
+            m_branch_index.build(tree);
+
+        return m_branch_index;
+    }
+
+    MemoryReport TreeWrapper::memoryReport() {
+        MemoryReport report;
+        collectMemory(report, "");
+
+        if (m_shared_cache && m_cache_owner)
+            report.clusterCache = ClusterCache::instance().ownerSize(m_cache_owner);
+        report.budget = m_memory_budget;
+
+        std::sort(report.branches.begin(), report.branches.end(), [](const BranchMemory& a, const BranchMemory& b) {
+                return a.total() > b.total();
+                });
+
+        return report;
+    }
+
+    void TreeWrapper::collectMemory(MemoryReport& report, const std::string& prefix) {
+        auto add = [&report, &prefix](const std::string& name, size_t buffer, TBranch* branch) {
+            BranchMemory memory;
+            memory.name = prefix + name;
+            memory.buffer = buffer;
+            memory.baskets = branch ? ROOT::utils::basketMemory(branch) : 0;
+
+            report.buffers += memory.buffer;
+            report.baskets += memory.baskets;
+            report.branches.push_back(memory);
+        };
+
+        for (auto& leaf: m_leafs)
+            add(leaf.first, leaf.second->bufferSize(), leaf.second->getBranch());
+
+        for (auto& vGroup: m_varrGroups) {
+            VarrGroup& group = *vGroup.second;
+            add(vGroup.first, group.m_lengthLeaf->bufferSize() + group.m_offsets.capacity() * sizeof(size_t), group.m_lengthLeaf->getBranch());
+            for (auto& leaf: group.m_leafs)
+                add(leaf.first, leaf.second->bufferSize(), leaf.second->getBranch());
+        }
+
+        if (m_tree)
+            report.treeCache += m_tree->GetCacheSize();
+        // Entries waiting for a sorted fill are copies of the write buffers
+        if (m_sorted_fill)
+            report.buffers += m_sorted_fill->memory();
+
+        for (auto& f: m_friends)
+            f.wrapper->collectMemory(report, f.alias.empty() ? prefix : prefix + f.alias + ".");
+    }
+
+    void TreeWrapper::setMemoryBudget(size_t bytes) {
+        m_memory_budget = bytes;
+        m_budget_check_at = 0;
+        m_budget_warned = false;
+
+        if (bytes)
+            return;
+
+        // Back to the default basket retention and an unbounded share of the cluster cache
+        m_max_virtual_size = 0;
+        setMaxVirtualSize();
+        if (m_cache_owner)
+            ClusterCache::instance().setOwnerMaxSize(m_cache_owner, 0);
+    }
+
+    void TreeWrapper::setMaxVirtualSize() {
+        if (m_tree)
+            m_tree->SetMaxVirtualSize(m_max_virtual_size);
+        // Not forwarded by TChain to the tree it is reading
+        if (m_chain && m_chain->GetTree())
+            m_chain->GetTree()->SetMaxVirtualSize(m_max_virtual_size);
+    }
+
+    void TreeWrapper::enforceMemoryBudget() {
+        // Never shrink the TTreeCache below this size, it would hurt more than it saves
+        static const size_t kMinCacheSize = 1024 * 1024;
+
+        MemoryReport report = memoryReport();
+        if (report.total() <= m_memory_budget)
+            return;
+
+        size_t excess = report.total() - m_memory_budget;
+
+        if (m_tree && report.treeCache > kMinCacheSize) {
+            size_t size = std::max(kMinCacheSize, report.treeCache > excess ? report.treeCache - excess : 0);
+            m_tree->SetCacheSize(size);
+            excess -= std::min(excess, report.treeCache - size);
+        }
+
+        if (excess && report.clusterCache) {
+            // Only the blocks decoded by this wrapper: other wrappers sharing the cache keep theirs.
+            // 0 means no limit for the cache, and the most recent block is always kept anyway.
+            size_t size = report.clusterCache > excess ? report.clusterCache - excess : 1;
+            ClusterCache::instance().setOwnerMaxSize(m_cache_owner, size);
+            excess -= std::min(excess, report.clusterCache - size);
+        }
+
+        if (excess && m_tree) {
+            // Let ROOT drop baskets by itself from now on. 0 means no limit for ROOT.
+            m_max_virtual_size = report.baskets > excess ? report.baskets - excess : 1;
+            setMaxVirtualSize();
+
+            TTree* tree = m_chain ? m_chain->GetTree() : m_tree;
+            if (tree)
+                tree->DropBaskets();
+
+            report = memoryReport();
+        }
+
+        if (report.total() > m_memory_budget && ! m_budget_warned) {
+            std::cout << "Warning: memory used by the tree wrapper is above the budget" << std::endl;
+            report.print(std::cout, 10);
+            m_budget_warned = true;
+        }
+    }
 };
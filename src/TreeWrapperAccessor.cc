@@ -18,4 +18,30 @@ namespace ROOT {
     uint64_t TreeWrapperAccessor::entry() {
         return wrapper->m_entry;
     }
+
+    uint64_t TreeWrapperAccessor::localEntry() {
+        return wrapper->m_local_entry;
+    }
+
+    uint64_t TreeWrapperAccessor::serial() {
+        return wrapper->m_serial;
+    }
+
+    const BranchOptions& TreeWrapperAccessor::branchOptions(const std::string& name) {
+        return wrapper->getBranchOptions(name);
+    }
+
+    TBranch* TreeWrapperAccessor::branch(const std::string& name) {
+        return wrapper->branchIndex().branch(name);
+    }
+
+    void TreeWrapperAccessor::activate(const std::string& name, TBranch* branch) {
+        if (! wrapper->branchIndex().activate(name))
+            ROOT::utils::activateBranch(branch);
+    }
+
+    void TreeWrapperAccessor::registerWrite(const std::string& name) {
+        if (wrapper->m_sorted_fill && ! wrapper->m_sorted_fill->empty())
+            throw std::runtime_error("Branch " + name + " cannot be registered for write while entries are buffered for a sorted fill. Register it before the first fill, or call TreeWrapper::flush first");
+    }
 }
@@ -0,0 +1,240 @@
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <TChain.h>
+#include <TFile.h>
+#include <TSystem.h>
+#include <TTree.h>
+
+#include <TreeWrapper.h>
+
+/* Round-trip tests of the reading features of TreeWrapper
+ *
+ * Each test writes a small tree with the wrapper, reads it back and checks the entries returned. Trees which need a
+ * cluster layout or a file name are written to temporary files. Return a non-zero code if any check fails.
+ */
+
+namespace {
+    int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (! (condition)) { \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            g_failures++; \
+        } \
+    } while (false)
+
+    std::string tempPath(const std::string& name) {
+        return std::string(gSystem->TempDirectory()) + "/TestTreeWrapper_" + std::to_string(gSystem->GetPid()) + "_" + name;
+    }
+
+    /* Write a tree of <entries> entries holding the leaves `run`, `event` and `x`, with clusters of 10 entries
+     * @path the file to create
+     * @firstEvent value of `event` for the first entry, incremented at each entry
+     * @stats if true, record cluster statistics for `x`
+     */
+    void writeFile(const std::string& path, int entries, int firstEvent, bool stats) {
+        TFile file(path.c_str(), "recreate");
+        TTree* tree = new TTree("t", "t");
+        tree->SetAutoFlush(10);
+
+        {
+            ROOT::TreeWrapper wrapper(tree);
+            int& run = wrapper["run"].write<int>();
+            int& event = wrapper["event"].write<int>();
+            int& x = wrapper["x"].write<int>();
+            if (stats)
+                wrapper.recordClusterStats({"x"}, 10);
+
+            for (int i = 0; i < entries; i++) {
+                run = 1;
+                event = firstEvent + i;
+                x = i;
+                wrapper.fill();
+            }
+            wrapper.flush();
+        }
+
+        file.Write();
+        file.Close();
+    }
+
+    // Views and vectors of a group read in bulk mode hold the same content as in the normal path
+    void testBulkRead() {
+        const int entries = 50;
+
+        TTree tree("bulk", "bulk");
+        tree.SetDirectory(nullptr);
+        {
+            ROOT::TreeWrapper wrapper(&tree);
+            auto& group = wrapper.varrGroup<int>("n");
+            std::vector<float>& v = group["v"].write<float>();
+            std::vector<float>& w = group["w"].write<float>();
+
+            for (int i = 0; i < entries; i++) {
+                for (int j = 0; j < i % 7; j++) {
+                    v.push_back(i * 100 + j);
+                    w.push_back(-(i * 100 + j));
+                }
+                wrapper.fill();
+            }
+        }
+
+        ROOT::TreeWrapper wrapper(&tree);
+        auto& group = wrapper.varrGroup<int>("n");
+        // Not a divisor of the number of entries, so that the last block is partial
+        group.setBulkRead(true, 16);
+        const ROOT::ArrayView<float>& v = group["v"].view<float>(10);
+        const std::vector<float>& w = group["w"].read<float>(10);
+
+        int read = 0;
+        bool content = true;
+        while (wrapper.next()) {
+            const int i = read++;
+            CHECK(v.size() == std::size_t(i % 7));
+            CHECK(w.size() == std::size_t(i % 7));
+            for (int j = 0; j < int(v.size()) && j < int(w.size()); j++)
+                content &= v[j] == float(i * 100 + j) && w[j] == -float(i * 100 + j);
+        }
+        CHECK(read == entries);
+        CHECK(content);
+
+        // Back to the normal path, the vector is still filled
+        group.setBulkRead(false);
+        wrapper.setEntry(3);
+        CHECK(wrapper.next());
+        CHECK(w.size() == 3 && w[2] == -302);
+    }
+
+    // Clusters whose statistics prove that no entry passes are skipped, the other ones are read
+    void testClusterSkipping() {
+        const std::string path = tempPath("clusters.root");
+        writeFile(path, 100, 0, true);
+
+        std::unique_ptr<TFile> file(TFile::Open(path.c_str()));
+        TTree* tree = static_cast<TTree*>(file->Get("t"));
+
+        ROOT::TreeWrapper wrapper(tree);
+        const int& x = wrapper["x"].read<int>();
+        wrapper.addClusterPredicate("x >= 75");
+
+        int read = 0;
+        int passed = 0;
+        while (wrapper.next()) {
+            read++;
+            if (x >= 75)
+                passed++;
+        }
+
+        CHECK(passed == 25);
+        CHECK(read == 30);
+        CHECK(wrapper.skippedEntries() == 70);
+
+        file->Close();
+        std::remove(path.c_str());
+    }
+
+    // Only the first occurrence of each key is returned, across the files of a chain
+    void testDuplicatesInChain() {
+        const std::string first = tempPath("duplicates_1.root");
+        const std::string second = tempPath("duplicates_2.root");
+        // Events 0 to 19, then 10 to 29
+        writeFile(first, 20, 0, false);
+        writeFile(second, 20, 10, false);
+
+        TChain chain("t");
+        chain.Add(first.c_str());
+        chain.Add(second.c_str());
+
+        ROOT::TreeWrapper wrapper(&chain);
+        const int& event = wrapper["event"].read<int>();
+        std::shared_ptr<ROOT::DuplicateFilter> filter = wrapper.removeDuplicates({"run", "event"});
+
+        std::set<int> events;
+        int read = 0;
+        while (wrapper.next()) {
+            read++;
+            events.insert(event);
+        }
+
+        CHECK(read == 30);
+        CHECK(events.size() == 30 && *events.begin() == 0 && *events.rbegin() == 29);
+        CHECK(filter->size() == 30);
+        CHECK(filter->duplicates() == 10);
+
+        std::remove(first.c_str());
+        std::remove(second.c_str());
+    }
+
+    // An interrupted loop resumed from its checkpoint processes each entry exactly once
+    void testCheckpointResume() {
+        const std::string path = tempPath("checkpoint.root");
+        const std::string checkpoint = tempPath("checkpoint.txt");
+        writeFile(path, 100, 0, false);
+        std::remove(checkpoint.c_str());
+
+        long expected = 0;
+        for (int i = 0; i < 100; i++)
+            expected += i;
+
+        long sum = 0;
+        {
+            std::unique_ptr<TFile> file(TFile::Open(path.c_str()));
+            ROOT::TreeWrapper wrapper(static_cast<TTree*>(file->Get("t")));
+            const int& x = wrapper["x"].read<int>();
+            // Save at each new cluster
+            wrapper.setCheckpoint(checkpoint, 0, [&sum](std::ostream& out) { out << sum; });
+
+            // Interrupted in the middle of the fourth cluster
+            while (wrapper.next()) {
+                sum += x;
+                if (x == 35)
+                    break;
+            }
+        }
+
+        sum = 0;
+        int read = 0;
+        {
+            std::unique_ptr<TFile> file(TFile::Open(path.c_str()));
+            ROOT::TreeWrapper wrapper(static_cast<TTree*>(file->Get("t")));
+            const int& x = wrapper["x"].read<int>();
+
+            CHECK(wrapper.resume(checkpoint, [&sum](std::istream& in) { in >> sum; }));
+            while (wrapper.next()) {
+                read++;
+                sum += x;
+            }
+        }
+
+        // The checkpoint was saved when entering the cluster starting at entry 30
+        CHECK(read == 70);
+        CHECK(sum == expected);
+
+        std::remove(path.c_str());
+        std::remove(checkpoint.c_str());
+    }
+}
+
+int main() {
+    const std::vector<std::pair<std::string, void(*)()>> tests = {
+        {"bulk read", testBulkRead},
+        {"cluster skipping", testClusterSkipping},
+        {"duplicates in a chain", testDuplicatesInChain},
+        {"checkpoint resume", testCheckpointResume}
+    };
+
+    for (const auto& test: tests) {
+        const int failures = g_failures;
+        test.second();
+        std::cout << (g_failures == failures ? "[ OK ] " : "[FAIL] ") << test.first << std::endl;
+    }
+
+    return g_failures ? 1 : 0;
+}